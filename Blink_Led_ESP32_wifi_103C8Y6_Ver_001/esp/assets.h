@@ -0,0 +1,107 @@
+/* Generated by build_assets.py from assets/ -- do not edit */
+#pragma once
+
+struct Asset {
+  const char    *url;
+  const char    *type;
+  const char    *etag;      // quoted, of the gzipped bytes
+  const uint8_t *gz;
+  size_t         len;
+};
+
+/* chart.html: 1446 -> 808 bytes */
+const uint8_t asset_chart_html[] = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x85, 0x54, 0x51, 0x6f, 0xdb, 0x36,
+  0x10, 0x7e, 0xf7, 0xaf, 0xb8, 0x6a, 0xc0, 0x44, 0xcd, 0xb2, 0x64, 0xbb, 0xd8, 0x90, 0xc5, 0xb2,
+  0x0a, 0x2c, 0x4d, 0x80, 0x01, 0x6d, 0x1a, 0xac, 0x7e, 0x29, 0x5c, 0x63, 0xa0, 0xc5, 0xb3, 0x44,
+  0x8c, 0x26, 0x05, 0x92, 0x76, 0xec, 0x0d, 0xf9, 0xef, 0x3b, 0x4a, 0x56, 0x9a, 0x15, 0xdb, 0xfa,
+  0x44, 0x1e, 0xef, 0xbb, 0x8f, 0xdf, 0xf1, 0xee, 0x58, 0xbc, 0x7a, 0xfb, 0xe1, 0x66, 0xf5, 0xe9,
+  0xe1, 0x16, 0x1a, 0xbf, 0x57, 0xe5, 0xa8, 0x18, 0x16, 0xe4, 0x82, 0x16, 0x2f, 0xbd, 0xc2, 0xf2,
+  0xe3, 0xea, 0xfd, 0xeb, 0x39, 0xac, 0x50, 0xe1, 0x1e, 0xbd, 0x3d, 0x17, 0x79, 0x7f, 0x3c, 0x2a,
+  0xf2, 0x0b, 0x6c, 0x6b, 0xc4, 0x39, 0x04, 0xcd, 0x9f, 0xa1, 0xfb, 0x16, 0x2d, 0xf7, 0x07, 0x8b,
+  0x84, 0x99, 0x93, 0xab, 0x2d, 0x8b, 0x2d, 0x48, 0xb1, 0x8c, 0x7c, 0x54, 0x4e, 0x8a, 0x7c, 0x5b,
+  0xc2, 0xf7, 0x02, 0xeb, 0xc5, 0x4d, 0x0a, 0xef, 0x6e, 0xdf, 0xc2, 0xc5, 0xa7, 0x2e, 0xbe, 0x22,
+  0x6f, 0x29, 0xa4, 0xe2, 0xfa, 0xc8, 0x5d, 0xe7, 0xa8, 0x22, 0x78, 0x94, 0xc2, 0x37, 0xcb, 0xe8,
+  0xa7, 0xe9, 0x34, 0x82, 0x06, 0x65, 0xdd, 0xf8, 0x65, 0x34, 0x0f, 0x86, 0xf3, 0x67, 0x85, 0xcb,
+  0x68, 0x6b, 0xac, 0x40, 0x7b, 0x3d, 0x6b, 0x4f, 0xe0, 0x8c, 0x92, 0x02, 0xbe, 0xbb, 0xba, 0xba,
+  0x8a, 0x88, 0xaa, 0xa7, 0x21, 0x3e, 0x57, 0x59, 0xd9, 0xfa, 0x72, 0x94, 0xe7, 0x10, 0x35, 0xd2,
+  0x79, 0x63, 0xcf, 0x11, 0x48, 0x07, 0x51, 0x61, 0xa5, 0xae, 0xc1, 0xc9, 0x3f, 0xb1, 0xfc, 0xac,
+  0x8b, 0xbd, 0x4b, 0x3d, 0xc9, 0xff, 0xfd, 0x34, 0x9b, 0xa6, 0x0a, 0xc5, 0x22, 0xcb, 0xb2, 0x32,
+  0x4a, 0xc1, 0x37, 0xa8, 0x01, 0x79, 0xd5, 0xc0, 0x1e, 0x9d, 0xe3, 0x35, 0x06, 0x1e, 0xde, 0xb6,
+  0xa8, 0x85, 0x03, 0xa3, 0x11, 0xa2, 0xaf, 0x02, 0xa3, 0x0c, 0x1e, 0x14, 0x97, 0x1a, 0x7a, 0x01,
+  0x29, 0x68, 0x03, 0x4a, 0x6e, 0x2d, 0xb7, 0x12, 0x5d, 0x36, 0x3a, 0x72, 0x0b, 0x02, 0x96, 0xb0,
+  0xde, 0xa4, 0x70, 0x4f, 0xeb, 0xeb, 0xe9, 0x34, 0x85, 0x8a, 0x36, 0xc2, 0x54, 0x87, 0x3d, 0x6a,
+  0x9f, 0xd5, 0xe8, 0x6f, 0xc3, 0x8b, 0x6b, 0xff, 0xcb, 0xf9, 0x57, 0xc1, 0xe2, 0x2a, 0x4e, 0x52,
+  0xa8, 0x09, 0x51, 0x05, 0xd7, 0x8d, 0xd1, 0x1e, 0x4f, 0x9e, 0xc5, 0x73, 0x11, 0x27, 0x8b, 0xd1,
+  0xee, 0xa0, 0x2b, 0x2f, 0x8d, 0x86, 0x96, 0xb9, 0x04, 0xfe, 0x82, 0x40, 0x7f, 0x24, 0xac, 0xcb,
+  0x5c, 0xab, 0x24, 0xc1, 0x52, 0x42, 0x81, 0x45, 0x2a, 0x89, 0x26, 0xb7, 0xbf, 0x86, 0xf1, 0x71,
+  0x3d, 0xa5, 0xbb, 0xab, 0x6b, 0x38, 0xae, 0x67, 0x1b, 0xc8, 0x81, 0x64, 0x83, 0x0a, 0xd6, 0x7c,
+  0x03, 0x4f, 0x0b, 0x78, 0xfa, 0xc2, 0x29, 0x2c, 0x7f, 0x64, 0xc4, 0x3a, 0x02, 0xa8, 0xb3, 0x4a,
+  0x21, 0xb7, 0xbf, 0x61, 0xe5, 0x19, 0xe1, 0x83, 0xe6, 0xac, 0x2b, 0x4d, 0xd8, 0xf4, 0x75, 0x21,
+  0x35, 0x00, 0x72, 0x07, 0xec, 0x95, 0xc8, 0x14, 0xea, 0xda, 0x37, 0xc9, 0xe5, 0xe2, 0xe0, 0x08,
+  0xc2, 0x94, 0x21, 0x65, 0x33, 0xfc, 0x39, 0x85, 0x46, 0xd2, 0x6e, 0xd2, 0x6d, 0x65, 0xf0, 0xee,
+  0x8c, 0x05, 0x16, 0xce, 0xa6, 0x0b, 0x90, 0x50, 0xc0, 0xc0, 0x40, 0xd6, 0x78, 0x1c, 0xf2, 0xea,
+  0x42, 0xdf, 0x73, 0xdf, 0x64, 0x7b, 0xa9, 0x99, 0x32, 0x29, 0x88, 0xb5, 0xdc, 0x64, 0x15, 0x25,
+  0xd7, 0x71, 0xf5, 0x2e, 0x7e, 0x62, 0x8d, 0x7c, 0xe1, 0x7a, 0x22, 0x6a, 0x8a, 0x9c, 0x10, 0x6f,
+  0xf6, 0x63, 0x87, 0x1c, 0xf7, 0xdb, 0x2e, 0xa3, 0x2d, 0xd6, 0x52, 0x3f, 0x50, 0x20, 0x4b, 0xbe,
+  0xad, 0x81, 0x00, 0x21, 0x46, 0x49, 0x8d, 0x2b, 0x43, 0xb0, 0x1f, 0x86, 0x07, 0xa0, 0x17, 0x64,
+  0xf7, 0x30, 0x81, 0x59, 0xf2, 0xe5, 0x29, 0xc8, 0x4b, 0x42, 0xe8, 0xf0, 0xa2, 0x24, 0x60, 0x3a,
+  0x5b, 0x99, 0x24, 0xe9, 0x2f, 0x77, 0xde, 0x9a, 0x3f, 0x90, 0x5d, 0xac, 0x9d, 0x54, 0x6a, 0x15,
+  0xca, 0xda, 0xc8, 0xcc, 0x9b, 0x3b, 0x79, 0x42, 0xc1, 0x02, 0xe1, 0x3c, 0xa5, 0xf2, 0x50, 0x22,
+  0x2f, 0x10, 0xca, 0x7c, 0x8d, 0x78, 0xbe, 0x75, 0x02, 0xf3, 0x64, 0x78, 0x6b, 0x17, 0x5a, 0x6a,
+  0x3d, 0xe4, 0x10, 0xf4, 0x6d, 0x82, 0xeb, 0x3f, 0xbb, 0xcc, 0xc7, 0x49, 0x16, 0x1a, 0xab, 0xeb,
+  0x2f, 0xed, 0xbb, 0x16, 0xaa, 0x5e, 0xdc, 0xf4, 0xbf, 0xc1, 0xea, 0x5f, 0x82, 0x15, 0x2c, 0x97,
+  0x10, 0xcf, 0x62, 0x78, 0x03, 0xf1, 0x87, 0xfb, 0x18, 0xae, 0x69, 0xb9, 0xbb, 0x8b, 0x17, 0xa3,
+  0xa7, 0x6e, 0x06, 0x30, 0x08, 0xd4, 0xf8, 0x08, 0xb7, 0x47, 0x8a, 0xf8, 0x68, 0x0e, 0xb6, 0x42,
+  0x16, 0xe7, 0x18, 0x2c, 0x17, 0x3a, 0x9b, 0x86, 0x85, 0x0b, 0xd1, 0x79, 0xdf, 0xd1, 0xd4, 0xa2,
+  0x46, 0xcb, 0xe2, 0xcb, 0xfc, 0xc6, 0x29, 0x3c, 0x37, 0x29, 0xc3, 0xbe, 0x43, 0x03, 0xe9, 0x89,
+  0x38, 0x31, 0x13, 0xdc, 0xf3, 0xa1, 0xfd, 0x3f, 0xeb, 0xb8, 0x93, 0x1e, 0x46, 0x6d, 0x7c, 0xa2,
+  0xce, 0xef, 0xf2, 0x20, 0xe3, 0x14, 0x9a, 0xff, 0x4d, 0xb7, 0x0c, 0xd8, 0x05, 0x65, 0xb1, 0xe7,
+  0x2d, 0x6b, 0x13, 0x12, 0xbb, 0xee, 0x91, 0xdd, 0x04, 0x90, 0xe6, 0x5e, 0x90, 0xd1, 0x97, 0x4f,
+  0x80, 0x08, 0xfe, 0x29, 0x80, 0xba, 0xa5, 0x3d, 0xb8, 0x86, 0xb5, 0xac, 0xbf, 0x9f, 0xca, 0xdc,
+  0xcd, 0xc2, 0x73, 0x01, 0x4a, 0xb8, 0x4f, 0x08, 0xe4, 0x1a, 0xb9, 0xf3, 0xc4, 0x38, 0x30, 0xd3,
+  0xc4, 0xd1, 0x77, 0x3a, 0x7c, 0x51, 0xf4, 0x09, 0xf6, 0x3f, 0x6a, 0xde, 0x7f, 0xc7, 0x7f, 0x03,
+  0x8b, 0x57, 0x1a, 0xed, 0xa6, 0x05, 0x00, 0x00,
+};
+
+/* index.html: 855 -> 492 bytes */
+const uint8_t asset_index_html[] = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x95, 0x53, 0xc1, 0x6e, 0xdb, 0x30,
+  0x0c, 0xbd, 0xfb, 0x2b, 0x38, 0x5d, 0x64, 0xa3, 0x85, 0x65, 0x77, 0x97, 0x21, 0x91, 0x5d, 0x60,
+  0x6d, 0x02, 0x0c, 0xd8, 0x9a, 0x02, 0x09, 0x30, 0xec, 0x28, 0xcb, 0x4c, 0x63, 0xc4, 0x91, 0x02,
+  0x89, 0x49, 0x1a, 0x0c, 0xfd, 0xf7, 0x49, 0x4e, 0x9a, 0x60, 0xc3, 0x76, 0xd8, 0xc1, 0x96, 0x41,
+  0xbe, 0xc7, 0xf7, 0x48, 0xd1, 0xf2, 0xc3, 0xe3, 0xec, 0x61, 0xf1, 0xe3, 0x79, 0x02, 0x2b, 0xda,
+  0xf4, 0x75, 0x22, 0xdf, 0x0f, 0x54, 0x6d, 0x38, 0xa8, 0xa3, 0x1e, 0xeb, 0xf9, 0xe2, 0xdb, 0xc7,
+  0x3b, 0xf8, 0x3a, 0x79, 0x84, 0x07, 0x6b, 0xc8, 0xd9, 0x5e, 0x8a, 0x53, 0x22, 0x91, 0x5e, 0xbb,
+  0x6e, 0x4b, 0x75, 0x22, 0x04, 0xcc, 0x0c, 0xc2, 0x77, 0x6c, 0xe6, 0x56, 0xaf, 0x91, 0x60, 0x8b,
+  0x0e, 0x1a, 0x67, 0x0f, 0x1e, 0xdd, 0x08, 0x9a, 0x1d, 0x91, 0x35, 0x1e, 0x3c, 0x9a, 0x16, 0x58,
+  0xc9, 0x40, 0x00, 0x2b, 0xd8, 0x2d, 0xd0, 0x0a, 0x61, 0x28, 0xce, 0x7d, 0xac, 0xc0, 0x82, 0x44,
+  0xf5, 0xca, 0xc0, 0xe1, 0xd6, 0x3a, 0x02, 0x6d, 0x37, 0xe8, 0xa1, 0x51, 0x7a, 0x0d, 0xd6, 0x0c,
+  0x58, 0xaf, 0x36, 0xe1, 0x35, 0x08, 0xe4, 0xc9, 0x5e, 0x39, 0x38, 0xf8, 0x71, 0xb2, 0xdc, 0x19,
+  0x4d, 0x5d, 0x40, 0x68, 0x6b, 0x0c, 0x6a, 0x4a, 0x33, 0xf8, 0x99, 0x40, 0x48, 0x41, 0x05, 0x06,
+  0x0f, 0x57, 0x4f, 0x29, 0x3f, 0xf8, 0x91, 0x10, 0x1c, 0x6e, 0xa0, 0xb7, 0x5a, 0x45, 0x4e, 0xbe,
+  0xb2, 0x9e, 0x4c, 0xac, 0x7a, 0x03, 0x7c, 0xf4, 0xa9, 0x14, 0x3c, 0x1b, 0x0f, 0xdc, 0xdc, 0x9a,
+  0x20, 0xee, 0xd5, 0x0b, 0x86, 0x2a, 0x17, 0x85, 0x14, 0x4f, 0xb5, 0x01, 0x5a, 0xab, 0x77, 0x1b,
+  0x34, 0x94, 0xbf, 0x20, 0x4d, 0x7a, 0x8c, 0x9f, 0x9f, 0x8f, 0x5f, 0xda, 0x94, 0x7b, 0x9e, 0xe5,
+  0x84, 0xaf, 0x14, 0x27, 0x15, 0x82, 0x50, 0x0d, 0x70, 0x00, 0xcc, 0x5b, 0x45, 0x0a, 0xaa, 0x0a,
+  0x78, 0xec, 0xb2, 0xe4, 0x70, 0x0f, 0x7c, 0xf6, 0xc4, 0x61, 0xf4, 0x67, 0xaa, 0x38, 0xa5, 0xa6,
+  0xd3, 0x6b, 0x2e, 0x7a, 0x7a, 0xbb, 0x18, 0xd3, 0xbd, 0xf5, 0xbf, 0xdb, 0xfa, 0x7f, 0x57, 0xc0,
+  0xed, 0x72, 0xd9, 0x77, 0x06, 0xf9, 0x78, 0x60, 0x7a, 0xa4, 0x45, 0xb7, 0x41, 0xbb, 0xa3, 0xf4,
+  0x3c, 0xc6, 0x5b, 0x28, 0x8b, 0xa2, 0xc8, 0xce, 0xd2, 0x6f, 0xd7, 0x31, 0xf7, 0xd8, 0xa6, 0xfb,
+  0xa0, 0x08, 0xdd, 0x12, 0xd2, 0x60, 0xc8, 0x85, 0x55, 0x39, 0xce, 0x49, 0x11, 0xc6, 0x16, 0xca,
+  0x2c, 0x9a, 0x8c, 0x17, 0x1d, 0x40, 0x63, 0x78, 0x4b, 0x2e, 0xb7, 0x32, 0x4e, 0xa4, 0x78, 0x5f,
+  0x17, 0x29, 0xce, 0x0b, 0xd6, 0xd8, 0xf6, 0x18, 0xd7, 0xed, 0xee, 0x6f, 0x4b, 0x16, 0xa2, 0x89,
+  0xdc, 0xd6, 0x21, 0x36, 0x02, 0xd9, 0x40, 0xd7, 0x56, 0xcc, 0xb3, 0xfa, 0x5e, 0x8a, 0xa6, 0x96,
+  0x62, 0x1b, 0xd9, 0xc3, 0x5e, 0x41, 0x1c, 0x49, 0xa7, 0xd7, 0x15, 0x8b, 0xd6, 0x78, 0xc9, 0x33,
+  0x16, 0x39, 0x30, 0x7b, 0x0a, 0xc8, 0x01, 0x51, 0xcb, 0xc6, 0x0d, 0xcf, 0x3f, 0x28, 0xc5, 0x85,
+  0x32, 0x9d, 0x5e, 0x38, 0x51, 0x5a, 0x2a, 0x58, 0x39, 0x5c, 0x56, 0x4c, 0xe8, 0x95, 0x72, 0x14,
+  0x40, 0xdd, 0x1e, 0x81, 0x30, 0xce, 0x96, 0xdc, 0x51, 0x0a, 0x75, 0x76, 0x22, 0xce, 0x8d, 0x88,
+  0xd3, 0xff, 0xf3, 0x0b, 0xbe, 0x18, 0xbf, 0x4e, 0x57, 0x03, 0x00, 0x00,
+};
+
+const Asset assets[] = {
+  { "/chart", "text/html", "\"e3854e94be54a0c3\"", asset_chart_html, sizeof(asset_chart_html) },
+  { "/", "text/html", "\"e9d276e1be9c4fc9\"", asset_index_html, sizeof(asset_index_html) },
+};
+
+#define ASSET_COUNT  (sizeof(assets) / sizeof(assets[0]))
@@ -0,0 +1,94 @@
+import gzip
+import hashlib
+import os
+
+# Build step for the web pages served by esp.ino:
+#
+#   python3 build_assets.py
+#
+# Every file in assets/ is gzipped (level 9, mtime 0 so the output only
+# changes when the file does) and written to assets.h as a const array
+# the linker keeps in flash, with its URL, Content-Type and ETag.
+# index.html is served at "/", other .html files without the extension
+# ("chart.html" -> "/chart"), anything else under its own name.
+# Run it after editing assets/ and commit assets.h with the change.
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SRC = os.path.join(HERE, "assets")
+OUT = os.path.join(HERE, "assets.h")
+
+TYPES = {
+    ".html": "text/html",
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".json": "application/json",
+    ".svg": "image/svg+xml",
+    ".ico": "image/x-icon",
+}
+
+
+def url_for(name):
+    stem, ext = os.path.splitext(name)
+    if name == "index.html":
+        return "/"
+    if ext == ".html":
+        return "/" + stem
+    return "/" + name
+
+
+def c_name(name):
+    return "asset_" + "".join(ch if ch.isalnum() else "_" for ch in name)
+
+
+def main():
+    lines = [
+        "/* Generated by build_assets.py from assets/ -- do not edit */",
+        "#pragma once",
+        "",
+        "struct Asset {",
+        "  const char    *url;",
+        "  const char    *type;",
+        "  const char    *etag;      // quoted, of the gzipped bytes",
+        "  const uint8_t *gz;",
+        "  size_t         len;",
+        "};",
+        "",
+    ]
+    table = []
+    total_raw = total_gz = 0
+
+    for name in sorted(os.listdir(SRC)):
+        ext = os.path.splitext(name)[1]
+        if ext not in TYPES:
+            continue
+        with open(os.path.join(SRC, name), "rb") as f:
+            raw = f.read()
+        gz = gzip.compress(raw, compresslevel=9, mtime=0)
+        etag = '\\"%s\\"' % hashlib.sha1(gz).hexdigest()[:16]
+        var = c_name(name)
+
+        lines.append("/* %s: %d -> %d bytes */" % (name, len(raw), len(gz)))
+        lines.append("const uint8_t %s[] = {" % var)
+        for i in range(0, len(gz), 16):
+            lines.append("  " + ", ".join("0x%02x" % b for b in gz[i:i + 16]) + ",")
+        lines.append("};")
+        lines.append("")
+        table.append('  { "%s", "%s", "%s", %s, sizeof(%s) },'
+                     % (url_for(name), TYPES[ext], etag, var, var))
+        total_raw += len(raw)
+        total_gz += len(gz)
+        print("%-12s %-8s %6d -> %5d bytes" % (name, url_for(name), len(raw), len(gz)))
+
+    lines.append("const Asset assets[] = {")
+    lines += table
+    lines.append("};")
+    lines.append("")
+    lines.append("#define ASSET_COUNT  (sizeof(assets) / sizeof(assets[0]))")
+
+    with open(OUT, "w") as f:
+        f.write("\n".join(lines) + "\n")
+    print("assets.h: %d -> %d bytes" % (total_raw, total_gz))
+
+
+if __name__ == "__main__":
+    main()
@@ -1,50 +1,465 @@
 #include <WiFi.h>
 #include <WebServer.h>
+#include <WebSocketsServer.h>   // "WebSockets" library by Markus Sattler
+#include "assets.h"             // python3 build_assets.py
 
 const char* ssid = "beaglebone";
 const char* password = "12345678910";
 
 WebServer server(80);
+WebSocketsServer ws(81);
 
-/* ================= MAIN WEB PAGE ================= */
-void rootPage() {
-  server.send(200, "text/html",
-    "<!DOCTYPE html>"
-    "<html>"
-    "<head>"
-    "<title>STM32 LED Control</title>"
-    "<script>"
-    "function ledOn(){ fetch('/on'); }"
-    "function ledOff(){ fetch('/off'); }"
-    "</script>"
-    "</head>"
-    "<body>"
-    "<h2>STM32 LED Control</h2>"
-    "<button onclick='ledOn()'>LED ON</button><br><br>"
-    "<button onclick='ledOff()'>LED OFF</button>"
-    "</body>"
-    "</html>"
-  );
-}
-
-/* ================= LED ON ================= */
-void ledOn() {
-  Serial.println("[WEB] LED ON");
-  Serial2.write('1');      // UART command
-  server.send(204);        // No content, no page change
-}
-
-/* ================= LED OFF ================= */
-void ledOff() {
-  Serial.println("[WEB] LED OFF");
-  Serial2.write('0');      // UART command
-  server.send(204);        // No content, no page change
+/* Last "LED=x" line from the STM32, sent to each new browser */
+char ledState[8] = "";
+
+/* ================= TELEMETRY RING ================= */
+/* Last SSE_HISTORY T_TELEM samples from the STM32 (10 Hz), replayed to a
+   new /events client in one "history" event before the live ones */
+#define SSE_HISTORY   300
+#define SSE_CLIENTS   4
+
+/* Widest text of the history event: led is 0/1 (see T_TELEM) */
+#define SSE_HIST_HEAD   "event: history\ndata: 65535\ndata: "
+#define SSE_HIST_SAMPLE "4294967295,-32768,1;"
+#define SSE_HIST_MAX    (sizeof(SSE_HIST_HEAD) - 1 +                          \
+                         SSE_HISTORY * (sizeof(SSE_HIST_SAMPLE) - 1) +       \
+                         sizeof("\n\n"))
+
+struct Sample {
+  uint32_t ms;
+  int16_t  temp_x10;
+  uint8_t  led;
+};
+
+Sample   ring[SSE_HISTORY];
+uint16_t ringHead = 0;          // next slot
+uint16_t ringCount = 0;
+
+WiFiClient sseClients[SSE_CLIENTS];
+uint8_t    sseNext = 0;         // slot reused when all are busy
+
+/* ================= STATIC ASSETS ================= */
+/* Pages live in assets/ and are gzipped into assets.h at build time,
+   so a page view sends the compressed bytes straight from flash.
+   "Cache-Control: no-cache" makes the browser revalidate every time
+   with If-None-Match; while the ETag still matches the answer is a
+   bodyless 304. Every browser accepts gzip, so nothing else is kept. */
+void serveAsset(const Asset &a) {
+  server.sendHeader("ETag", a.etag);
+  server.sendHeader("Cache-Control", "no-cache");
+
+  if (server.header("If-None-Match") == a.etag) {
+    server.send(304);
+    return;
+  }
+
+  server.sendHeader("Content-Encoding", "gzip");
+  server.send_P(200, a.type, (const char *)a.gz, a.len);
+}
+
+/* ================= WEBSOCKET ================= */
+void wsEvent(uint8_t num, WStype_t type, uint8_t *payload, size_t length) {
+  switch (type) {
+    case WStype_CONNECTED:
+      Serial.printf("[WS] client %u connected\n", num);
+      if (ledState[0])
+        ws.sendTXT(num, ledState);
+      break;
+
+    case WStype_TEXT:
+      if (length == 1 && (payload[0] == '1' || payload[0] == '0')) {
+        bridgeCommand(payload[0]);    // to the UART task, before any logging
+        Serial.printf("[WS] LED %s\n", payload[0] == '1' ? "ON" : "OFF");
+      }
+      break;
+
+    case WStype_DISCONNECTED:
+      Serial.printf("[WS] client %u gone\n", num);
+      break;
+
+    default:
+      break;
+  }
+}
+
+/* ================= SERVER-SENT EVENTS ================= */
+/* The socket is taken over from WebServer: headers are written by
+   hand and a copy of the WiFiClient kept, which holds the connection
+   open after the handler returns. With every slot busy the slots are
+   reused in turn. */
+void sseSubscribe() {
+  static char history[SSE_HIST_MAX];
+  WiFiClient client = server.client();
+  char *p = history;
+  char *end = history + sizeof(history);
+  int n;
+  int slot = -1;
+
+  client.setNoDelay(true);
+  client.print("HTTP/1.1 200 OK\r\n"
+               "Content-Type: text/event-stream\r\n"
+               "Cache-Control: no-cache\r\n"
+               "Connection: keep-alive\r\n\r\n");
+
+  /* Whole backlog in one write: ring size, then
+     "ms,temp,led;ms,temp,led..." */
+  p += snprintf(p, end - p, "event: history\ndata: %u\ndata: ", SSE_HISTORY);
+  for (uint16_t i = 0; i < ringCount; i++) {
+    const Sample &s = ring[(ringHead + SSE_HISTORY - ringCount + i) % SSE_HISTORY];
+    n = snprintf(p, end - p, "%s%lu,%d,%u", i ? ";" : "",
+                 (unsigned long)s.ms, s.temp_x10, s.led);
+    if (n < 0 || n >= end - p - 2)    // keep room for "\n\n"
+      break;
+    p += n;
+  }
+  p += snprintf(p, end - p, "\n\n");
+  client.write((const uint8_t *)history, p - history);
+
+  for (int i = 0; i < SSE_CLIENTS && slot < 0; i++) {
+    if (!sseClients[i].connected())
+      slot = i;
+  }
+  if (slot < 0) {
+    slot = sseNext;
+    sseNext = (sseNext + 1) % SSE_CLIENTS;
+    sseClients[slot].stop();
+  }
+  sseClients[slot] = client;
+
+  Serial.printf("[SSE] client %d, %u samples replayed\n", slot, ringCount);
+}
+
+void ssePush(const Sample &s) {
+  char msg[40];
+  int n = sprintf(msg, "data: %lu,%d,%u\n\n",
+                  (unsigned long)s.ms, s.temp_x10, s.led);
+
+  for (int i = 0; i < SSE_CLIENTS; i++) {
+    if (!sseClients[i].connected())
+      continue;
+    if (sseClients[i].write((const uint8_t *)msg, n) != (size_t)n)
+      sseClients[i].stop();
+  }
+}
+
+/* ================= LINK FRAMING ================= */
+/* Same frames as the STM32 (main.c, LINK):
+
+     seq | type | body ... | crc16 lo | crc16 hi
+
+   CRC-16/CCITT-FALSE over seq..body, COBS encoded, 0x00 terminated.
+   Commands go out as one T_CMD holding every {op, arg} queued so far.
+   Only one T_CMD is in flight at a time. If its T_ACK has not come
+   within ACK_MS it is resent with the same seq, up to ACK_TRIES times.
+   The STM32 acks a repeated seq again without executing it. Since it
+   remembers the last seq across our reboots, the bridge first sends
+   T_SYNC (retried every SYNC_RETRY_MS until acked), which makes the
+   STM32 forget it; no command goes out before that. */
+#define LINK_BAUD       921600
+#define FRAME_MAX       24      // decoded, crc included
+#define FRAME_WIRE      (FRAME_MAX + FRAME_MAX / 254 + 2)
+#define BATCH_MAX       ((FRAME_MAX - 4) / 2)   // commands per T_CMD
+#define ACK_MS          20
+#define ACK_TRIES       3
+#define SYNC_RETRY_MS   500
+
+#define T_CMD           0x01
+#define T_ACK           0x02
+#define T_LED           0x03
+#define T_TELEM         0x04
+#define T_SYNC          0x05
+
+#define OP_LED          0x01
+#define OP_QUERY        0x02
+
+#define ACK_OK          0
+
+uint16_t crc16(const uint8_t *p, size_t len) {
+  uint16_t crc = 0xFFFF;
+
+  while (len--) {
+    crc ^= (uint16_t)*p++ << 8;
+    for (int b = 0; b < 8; b++)
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+size_t cobsEncode(const uint8_t *in, size_t len, uint8_t *out) {
+  uint8_t *codeP = out;
+  uint8_t *p = out + 1;
+  uint8_t code = 1;
+
+  while (len--) {
+    if (*in) {
+      *p++ = *in;
+      code++;
+    }
+    if (!*in++ || code == 0xFF) {
+      *codeP = code;
+      codeP = p++;
+      code = 1;
+    }
+  }
+  *codeP = code;
+  return p - out;
+}
+
+/* Decoded length, 0 if malformed */
+size_t cobsDecode(const uint8_t *in, size_t len, uint8_t *out) {
+  size_t i = 0, n = 0;
+
+  while (i < len) {
+    uint8_t code = in[i++];
+
+    if (code == 0 || i + code - 1 > len)
+      return 0;
+    for (uint8_t k = 1; k < code; k++)
+      out[n++] = in[i++];
+    if (code != 0xFF && i < len)
+      out[n++] = 0;
+  }
+  return n;
+}
+
+/* seq, type, body -> wire bytes in out, returns their count */
+size_t linkBuild(uint8_t seq, uint8_t type, const uint8_t *body, size_t len,
+                 uint8_t *out) {
+  uint8_t frame[FRAME_MAX];
+  uint16_t crc;
+  size_t n;
+
+  frame[0] = seq;
+  frame[1] = type;
+  if (len)
+    memcpy(frame + 2, body, len);
+  crc = crc16(frame, len + 2);
+  frame[len + 2] = crc;
+  frame[len + 3] = crc >> 8;
+
+  n = cobsEncode(frame, len + 4, out);
+  out[n++] = 0;
+  return n;
+}
+
+/* ================= SERIAL BRIDGE TASK ================= */
+/* Serial2 belongs to bridgeTask alone, pinned to core 0 next to the
+   Wi-Fi driver, while loop() runs the web stack on core 1. The two
+   only meet in two queues, sent with zero timeout on the web side:
+     cmdQueue    web -> STM32   command bytes ('1', '0', '?')
+     reportQueue STM32 -> web   T_LED / T_TELEM frames, parsed
+   A slow browser no longer stalls the UART, and a burst of telemetry
+   no longer stalls the web server. */
+#define BRIDGE_CORE     0
+#define BRIDGE_PRIO     5       // above loop() (1), below Wi-Fi (23)
+#define CMD_QUEUE_LEN   16
+#define REPORT_QUEUE_LEN 32
+
+enum { REPORT_LED, REPORT_SAMPLE };
+
+struct Report {
+  uint8_t kind;
+  Sample  s;                    // REPORT_LED: only s.led
+};
+
+QueueHandle_t cmdQueue;
+QueueHandle_t reportQueue;
+volatile uint32_t reportDrops = 0;
+
+/* Link counters, bridge task only */
+uint32_t linkBad = 0;           // failed COBS / CRC
+uint32_t linkLost = 0;          // gaps in the STM32's seq
+uint32_t linkRetries = 0;
+uint32_t linkFailed = 0;        // T_CMD given up after ACK_TRIES
+
+/* The T_CMD / T_SYNC in flight */
+uint8_t  txSeq;
+uint8_t  txType;
+bool     synced = false;        // STM32 acked our T_SYNC
+uint8_t  txWire[FRAME_WIRE];
+size_t   txWireLen;
+uint8_t  txTries = 0;           // 0: nothing in flight
+uint32_t txSentMs;
+
+void bridgeReport(const Report &r) {
+  if (xQueueSend(reportQueue, &r, 0) != pdTRUE)
+    reportDrops++;            // web side behind; newest is dropped
+}
+
+void bridgeFrame(const uint8_t *f, size_t n) {
+  static bool rxSeen = false;
+  static uint8_t rxNext;
+  const uint8_t *body = f + 2;
+  size_t len = n - 4;
+  Report r;
+
+  if (rxSeen && f[0] != rxNext)
+    linkLost += (uint8_t)(f[0] - rxNext);
+  rxSeen = true;
+  rxNext = f[0] + 1;
+
+  switch (f[1]) {
+    case T_ACK:
+      if (len == 2 && txTries && body[0] == txSeq) {
+        if (body[1] != ACK_OK)
+          Serial.printf("[LINK] cmd %u rejected (%u)\n", txSeq, body[1]);
+        if (txType == T_SYNC)
+          synced = true;
+        txTries = 0;
+      }
+      break;
+
+    case T_LED:
+      if (len != 1)
+        break;
+      r.kind = REPORT_LED;
+      r.s.led = body[0] != 0;
+      bridgeReport(r);
+      break;
+
+    case T_TELEM:
+      if (len != 7)
+        break;
+      r.kind = REPORT_SAMPLE;
+      r.s.ms = body[0] | body[1] << 8 | body[2] << 16 | (uint32_t)body[3] << 24;
+      r.s.temp_x10 = (int16_t)(body[4] | body[5] << 8);
+      r.s.led = body[6] != 0;
+      bridgeReport(r);
+      break;
+  }
+}
+
+void bridgeSend(uint8_t type, const uint8_t *body, size_t len) {
+  txSeq++;
+  txType = type;
+  txWireLen = linkBuild(txSeq, type, body, len, txWire);
+  Serial2.write(txWire, txWireLen);
+  txTries = 1;
+  txSentMs = millis();
+}
+
+/* Everything queued (up to BATCH_MAX) into one T_CMD */
+void bridgeSendBatch(char cmd) {
+  uint8_t body[BATCH_MAX * 2];
+  size_t len = 0;
+
+  do {
+    if (cmd == '1' || cmd == '0') {
+      body[len++] = OP_LED;
+      body[len++] = cmd - '0';
+    } else if (cmd == '?') {
+      body[len++] = OP_QUERY;
+      body[len++] = 0;
+    }
+  } while (len < sizeof(body) && xQueueReceive(cmdQueue, &cmd, 0) == pdTRUE);
+
+  if (len)
+    bridgeSend(T_CMD, body, len);
+}
+
+void bridgeTask(void *arg) {
+  static uint8_t raw[FRAME_WIRE];
+  size_t rawLen = 0;
+  bool overflow = false;
+  uint8_t frame[FRAME_WIRE];   // a bad frame may decode longer
+  uint32_t syncNextMs = 0;
+  char cmd;
+
+  for (;;) {
+    if (!synced) {
+      /* Commands wait in cmdQueue until the STM32 answers */
+      if (!txTries && (int32_t)(millis() - syncNextMs) >= 0) {
+        bridgeSend(T_SYNC, NULL, 0);
+        syncNextMs = millis() + SYNC_RETRY_MS;
+      }
+    }
+
+    if (!txTries) {
+      /* Sleeps here (1 tick) when idle; a command wakes it at once */
+      if (!synced)
+        vTaskDelay(1);
+      else if (xQueueReceive(cmdQueue, &cmd, 1) == pdTRUE)
+        bridgeSendBatch(cmd);
+    } else if (millis() - txSentMs >= ACK_MS) {
+      if (txTries == ACK_TRIES) {
+        txTries = 0;
+        if (txType == T_CMD) {
+          linkFailed++;
+          Serial.printf("[LINK] cmd %u not acked\n", txSeq);
+        }
+      } else {
+        Serial2.write(txWire, txWireLen);
+        linkRetries++;
+        txTries++;
+        txSentMs = millis();
+      }
+    } else {
+      vTaskDelay(1);
+    }
+
+    while (Serial2.available()) {
+      uint8_t c = Serial2.read();
+
+      if (c) {
+        if (rawLen < sizeof(raw))
+          raw[rawLen++] = c;
+        else
+          overflow = true;
+        continue;
+      }
+
+      if (rawLen) {
+        size_t n = overflow ? 0 : cobsDecode(raw, rawLen, frame);
+
+        if (n >= 4 && n <= FRAME_MAX &&
+            crc16(frame, n - 2) == (frame[n - 2] | frame[n - 1] << 8))
+          bridgeFrame(frame, n);
+        else
+          linkBad++;
+      }
+      rawLen = 0;
+      overflow = false;
+    }
+  }
+}
+
+/* Web side (core 1): queue a command, never waits */
+void bridgeCommand(char c) {
+  xQueueSend(cmdQueue, &c, 0);
+}
+
+/* Web side (core 1): "LED=x" goes to every WebSocket, samples into
+   the ring and out to every SSE client */
+void bridgePoll() {
+  Report r;
+
+  while (xQueueReceive(reportQueue, &r, 0) == pdTRUE) {
+    if (r.kind == REPORT_LED) {
+      strcpy(ledState, r.s.led ? "LED=1" : "LED=0");
+      ws.broadcastTXT(ledState);
+      continue;
+    }
+
+    ring[ringHead] = r.s;
+    ringHead = (ringHead + 1) % SSE_HISTORY;
+    if (ringCount < SSE_HISTORY)
+      ringCount++;
+
+    ssePush(r.s);
+  }
 }
 
 /* ================= SETUP ================= */
 void setup() {
   Serial.begin(115200);
-  Serial2.begin(9600, SERIAL_8N1, 16, 17);
+  Serial2.setRxBufferSize(1024);
+  Serial2.begin(LINK_BAUD, SERIAL_8N1, 16, 17);
+  Serial2.write((uint8_t)0);   // ends any partial frame at the STM32
+
+  cmdQueue = xQueueCreate(CMD_QUEUE_LEN, sizeof(char));
+  reportQueue = xQueueCreate(REPORT_QUEUE_LEN, sizeof(Report));
+  xTaskCreatePinnedToCore(bridgeTask, "bridge", 4096, NULL,
+                          BRIDGE_PRIO, NULL, BRIDGE_CORE);
 
   WiFi.begin(ssid, password);
   while (WiFi.status() != WL_CONNECTED) {
@@ -54,13 +469,23 @@ void setup() {
   Serial.print("ESP32 IP: ");
   Serial.println(WiFi.localIP());
 
-  server.on("/", rootPage);
-  server.on("/on", ledOn);
-  server.on("/off", ledOff);
+  static const char *cacheHeaders[] = { "If-None-Match" };
+  server.collectHeaders(cacheHeaders, 1);
+
+  for (size_t i = 0; i < ASSET_COUNT; i++)
+    server.on(assets[i].url, HTTP_GET, [i]() { serveAsset(assets[i]); });
+  server.on("/events", sseSubscribe);
   server.begin();
+
+  ws.begin();
+  ws.onEvent(wsEvent);
+
+  bridgeCommand('?');      // ask the STM32 for the current state
 }
 
 /* ================= LOOP ================= */
 void loop() {
   server.handleClient();
+  ws.loop();
+  bridgePoll();
 }
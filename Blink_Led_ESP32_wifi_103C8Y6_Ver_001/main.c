@@ -1,6 +1,8 @@
 #include <stdint.h>
+#include <string.h>
 
 /* ================= RCC ================= */
+#define RCC_CFGR      (*(volatile uint32_t*)0x40021004)
 #define RCC_APB2ENR   (*(volatile uint32_t*)0x40021018)
 #define RCC_APB1ENR   (*(volatile uint32_t*)0x4002101C)
 
@@ -25,6 +27,74 @@
 #define USART3_BRR    (*(volatile uint32_t*)0x40004808)
 #define USART3_CR1    (*(volatile uint32_t*)0x4000480C)
 
+/* ================= ADC ================= */
+#define ADC1_CR2      (*(volatile uint32_t*)0x40012408)
+#define ADC1_SMPR1    (*(volatile uint32_t*)0x4001240C)
+#define ADC1_SQR3     (*(volatile uint32_t*)0x40012434)
+#define ADC1_DR       (*(volatile uint32_t*)0x4001244C)
+
+/* ================= SYSTICK ================= */
+#define SYST_CSR      (*(volatile uint32_t*)0xE000E010)
+#define SYST_RVR      (*(volatile uint32_t*)0xE000E014)
+#define SYST_CVR      (*(volatile uint32_t*)0xE000E018)
+
+/* ================= NVIC ================= */
+#define NVIC_ISER1    (*(volatile uint32_t*)0xE000E104)
+
+/* ================= CLOCK TREE ================= */
+/* Same selection as SetSysClockTo72() in system_stm32f10x.c:
+   HSE 8 MHz x PLL 9 = SYSCLK 72 MHz, AHB /1, APB1 /2, APB2 /1 */
+#define HSE_HZ        8000000UL
+#define SYSCLK_HZ     (HSE_HZ * 9)
+#define HCLK_HZ       (SYSCLK_HZ / 1)
+#define PCLK1_HZ      (HCLK_HZ / 2)       // APB1: USART2/3, I2C1
+#define PCLK2_HZ      (HCLK_HZ / 1)       // APB2: USART1, SPI1, ADC1
+
+/* USART, 16x oversampling: BRR = PCLK / baud, error in 0.1 % steps */
+#define USART_BRR(pclk, baud)   (((pclk) + (baud) / 2) / (baud))
+#define USART_REAL(pclk, baud)  ((pclk) / USART_BRR(pclk, baud))
+#define USART_ERR(pclk, baud)                                   \
+    ((USART_REAL(pclk, baud) > (baud) ?                         \
+      USART_REAL(pclk, baud) - (baud) :                         \
+      (baud) - USART_REAL(pclk, baud)) * 1000 / (baud))
+#define USART_CHECK(pclk, baud, name)                           \
+    _Static_assert(USART_BRR(pclk, baud) >= 16 &&               \
+                   USART_ERR(pclk, baud) <= 20,                 \
+                   name " baud rate out of tolerance")
+
+/* ADC: smallest ADCPRE (/2 /4 /6 /8) keeping ADCCLK <= 14 MHz */
+#define ADC_MAX_HZ    14000000UL
+#define ADCPRE_BITS   (PCLK2_HZ / 2 <= ADC_MAX_HZ ? 0 :         \
+                       PCLK2_HZ / 4 <= ADC_MAX_HZ ? 1 :         \
+                       PCLK2_HZ / 6 <= ADC_MAX_HZ ? 2 : 3)
+#define ADCCLK_HZ     (PCLK2_HZ / (2 * (ADCPRE_BITS + 1)))
+_Static_assert(ADCCLK_HZ <= ADC_MAX_HZ, "ADCCLK above 14 MHz");
+
+/* Temperature sensor wants >= 17.1 us sampling; 239.5 cycles it is */
+_Static_assert(2395UL * 100000 / (ADCCLK_HZ / 100) >= 1710,
+               "ADC sample time too short for the temperature sensor");
+
+#define DEBUG_BAUD    9600
+#define ESP_BAUD      921600
+USART_CHECK(PCLK1_HZ, DEBUG_BAUD, "USART2");
+USART_CHECK(PCLK1_HZ, ESP_BAUD, "USART3");
+
+/* ================= GLOBALS ================= */
+volatile uint32_t ms_ticks = 0;
+
+/* ================= SYSTICK ================= */
+void SysTick_Init(void)
+{
+    SYST_RVR = HCLK_HZ / 1000 - 1;      // 1 ms
+    SYST_CVR = 0;
+    SYST_CSR = 7;                       // HCLK, TICKINT, ENABLE
+}
+
+void SysTick_Handler(void)
+{
+    ms_ticks++;
+}
+
 /* ================= UART2 DEBUG ================= */
 void UART2_Init(void)
 {
@@ -34,7 +104,7 @@ void UART2_Init(void)
     GPIOA_CRL &= ~(0xF << 8);
     GPIOA_CRL |=  (0xB << 8);     // PA2 TX
 
-    USART2_BRR = 0xEA6;           // 9600 @ 36MHz
+    USART2_BRR = USART_BRR(PCLK1_HZ, DEBUG_BAUD);
     USART2_CR1 |= (1<<13)|(1<<3)|(1<<2);
 }
 
@@ -50,22 +120,81 @@ void UART2_SendString(const char *s)
 }
 
 /* ================= UART3 ESP32 ================= */
+/* Interrupt driven both ways: at 921600 a byte lands every 11 us, far
+   less than one debug character on USART2 takes. RX fills a 256-byte
+   ring (uint8_t indices wrap by themselves), TX drains a ring with
+   TXEIE enabled only while it holds data. */
+#define ESP_TX_SIZE   128             // power of two
+
+volatile uint8_t esp_rx_buf[256];
+volatile uint8_t esp_rx_head, esp_rx_tail;
+
+volatile uint8_t esp_tx_buf[ESP_TX_SIZE];
+volatile uint8_t esp_tx_head, esp_tx_tail;
+
 void UART3_Init(void)
 {
     RCC_APB2ENR |= (1 << 3);      // GPIOB
     RCC_APB1ENR |= (1 << 18);     // USART3
 
-    GPIOB_CRH &= ~(0xF << 12);
+    GPIOB_CRH &= ~((0xF << 8) | (0xF << 12));
+    GPIOB_CRH |=  (0xB << 8);     // PB10 TX
     GPIOB_CRH |=  (0x4 << 12);    // PB11 RX
 
-    USART3_BRR = 0xEA6;           // 9600 @ 36MHz
-    USART3_CR1 |= (1<<13)|(1<<2);
+    USART3_BRR = USART_BRR(PCLK1_HZ, ESP_BAUD);
+    USART3_CR1 |= (1<<13)|(1<<5)|(1<<3)|(1<<2);   // UE, RXNEIE, TE, RE
+    NVIC_ISER1 |= (1<<7);         // USART3 = IRQ39
 }
 
-char UART3_Read(void)
+void USART3_IRQHandler(void)
 {
-    while (!(USART3_SR & (1<<5)));
-    return USART3_DR;
+    if (USART3_SR & (1<<5))       // RXNE; the DR read also clears ORE
+    {
+        uint8_t c = USART3_DR;
+        uint8_t next = esp_rx_head + 1;
+
+        if (next != esp_rx_tail)  // full: drop, the CRC catches it
+        {
+            esp_rx_buf[esp_rx_head] = c;
+            esp_rx_head = next;
+        }
+    }
+
+    if ((USART3_CR1 & (1<<7)) && (USART3_SR & (1<<7)))
+    {
+        if (esp_tx_tail != esp_tx_head)
+        {
+            USART3_DR = esp_tx_buf[esp_tx_tail];
+            esp_tx_tail = (esp_tx_tail + 1) & (ESP_TX_SIZE - 1);
+        }
+        else
+            USART3_CR1 &= ~(1<<7);    // empty: TXEIE off
+    }
+}
+
+int UART3_GetChar(uint8_t *c)
+{
+    if (esp_rx_tail == esp_rx_head)
+        return 0;
+    *c = esp_rx_buf[esp_rx_tail++];
+    return 1;
+}
+
+uint8_t UART3_TxFree(void)
+{
+    return ESP_TX_SIZE - 1 - ((esp_tx_head - esp_tx_tail) & (ESP_TX_SIZE - 1));
+}
+
+/* Queues len bytes; waits only while the ring is full */
+void UART3_Write(const uint8_t *p, uint8_t len)
+{
+    while (len--)
+    {
+        while (!UART3_TxFree());
+        esp_tx_buf[esp_tx_head] = *p++;
+        esp_tx_head = (esp_tx_head + 1) & (ESP_TX_SIZE - 1);
+        USART3_CR1 |= (1<<7);         // TXEIE
+    }
 }
 
 /* ================= GPIO ================= */
@@ -82,32 +211,295 @@ void GPIO_Init(void)
     GPIOB_ODR &= ~(1<<4);             // LED OFF
 }
 
+/* ================= ADC (TEMPERATURE) ================= */
+/* Internal sensor on channel 16, converting continuously; DR always
+   holds the latest reading. */
+void ADC_Init(void)
+{
+    RCC_APB2ENR |= (1<<9);            // ADC1
+    RCC_CFGR &= ~(3<<14);
+    RCC_CFGR |= (ADCPRE_BITS<<14);
+
+    ADC1_SMPR1 |= (7<<18);            // ch16: 239.5 cycles
+    ADC1_SQR3 = 16;
+
+    ADC1_CR2 |= (1<<23)|(1<<1)|(1<<0);   // TSVREFE, CONT, ADON
+    for (volatile int i = 0; i < 1000; i++);  // tSTAB
+
+    ADC1_CR2 |= (1<<3);
+    while(ADC1_CR2&(1<<3));
+
+    ADC1_CR2 |= (1<<2);
+    while(ADC1_CR2&(1<<2));
+
+    ADC1_CR2 |= (1<<0);               // start
+}
+
+/* Datasheet typicals: V25 = 1.43 V, slope 4.3 mV/C, VDDA = 3.3 V */
+int32_t Temp_Read_x10(void)
+{
+    int32_t mv = (ADC1_DR & 0xFFF) * 3300 / 4095;
+
+    return (1430 - mv) * 100 / 43 + 250;
+}
+
+/* ================= LINK ================= */
+/* Frames to and from the ESP32 (esp.ino, LINK FRAMING):
+
+     seq | type | body ... | crc16 lo | crc16 hi
+
+   CRC-16/CCITT-FALSE over seq..body, COBS encoded, 0x00 terminated:
+   a receiver resyncs on the next 0x00 after noise or a lost byte, and
+   a damaged frame fails its CRC and is dropped. Each side numbers its
+   own frames.
+
+   ESP32 -> STM32  T_CMD    {op, arg} x n, several commands per frame
+                   T_SYNC   {}, new ESP32 session: forget the last seq
+   STM32 -> ESP32  T_ACK    {seq, status}, one per T_CMD / T_SYNC
+                   T_LED    {led}, after every T_CMD
+                   T_TELEM  {ms u32, temp_x10 i16, led u8}, LE
+
+   Only T_CMD and T_SYNC are acknowledged. The ESP32 resends with the
+   same seq when the ack does not come; a repeat of the last T_CMD seq
+   is acked (and its T_LED sent) again but not executed. A rebooted
+   ESP32 restarts its numbering, so before its first T_CMD it sends
+   T_SYNC until acked; that clears the duplicate check here. */
+#define FRAME_MAX     24              // decoded, crc included
+#define FRAME_WIRE    (FRAME_MAX + FRAME_MAX / 254 + 2)   // COBS + 0x00
+
+#define T_CMD         0x01
+#define T_ACK         0x02
+#define T_LED         0x03
+#define T_TELEM       0x04
+#define T_SYNC        0x05
+
+#define OP_LED        0x01            // arg: 0 off, 1 on
+#define OP_QUERY      0x02            // only the T_LED answer
+
+#define ACK_OK        0
+#define ACK_BAD_OP    1
+
+uint8_t  link_tx_seq;
+uint32_t link_bad;                    // frames failing COBS / CRC
+
+uint16_t Crc16(const uint8_t *p, uint8_t len)
+{
+    uint16_t crc = 0xFFFF;
+
+    while (len--)
+    {
+        crc ^= (uint16_t)*p++ << 8;
+        for (int b = 0; b < 8; b++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+/* Returns encoded length; no 0x00 in out */
+uint8_t Cobs_Encode(const uint8_t *in, uint8_t len, uint8_t *out)
+{
+    uint8_t *code_p = out;
+    uint8_t *p = out + 1;
+    uint8_t code = 1;
+
+    while (len--)
+    {
+        if (*in)
+        {
+            *p++ = *in;
+            code++;
+        }
+        if (!*in++ || code == 0xFF)
+        {
+            *code_p = code;
+            code_p = p++;
+            code = 1;
+        }
+    }
+    *code_p = code;
+    return p - out;
+}
+
+/* Returns decoded length, 0 if malformed */
+uint8_t Cobs_Decode(const uint8_t *in, uint8_t len, uint8_t *out)
+{
+    uint8_t i = 0, n = 0;
+
+    while (i < len)
+    {
+        uint8_t code = in[i++];
+
+        if (code == 0 || i + code - 1 > len)
+            return 0;
+        for (uint8_t k = 1; k < code; k++)
+            out[n++] = in[i++];
+        if (code != 0xFF && i < len)
+            out[n++] = 0;
+    }
+    return n;
+}
+
+void Link_Send(uint8_t type, const uint8_t *body, uint8_t len)
+{
+    uint8_t frame[FRAME_MAX];
+    uint8_t wire[FRAME_WIRE];
+    uint16_t crc;
+    uint8_t n;
+
+    frame[0] = link_tx_seq++;
+    frame[1] = type;
+    memcpy(frame + 2, body, len);
+    crc = Crc16(frame, len + 2);
+    frame[len + 2] = crc;
+    frame[len + 3] = crc >> 8;
+
+    n = Cobs_Encode(frame, len + 4, wire);
+    wire[n++] = 0;
+    UART3_Write(wire, n);
+}
+
+void Link_Frame(uint8_t seq, uint8_t type, const uint8_t *body, uint8_t len);
+
+/* Bytes from the RX ring -> whole, CRC-checked frames */
+void Link_Poll(void)
+{
+    static uint8_t raw[FRAME_WIRE];
+    static uint8_t raw_len;
+    static uint8_t overflow;
+    uint8_t frame[FRAME_WIRE];        // a bad frame may decode longer
+    uint8_t c, n;
+
+    while (UART3_GetChar(&c))
+    {
+        if (c)
+        {
+            if (raw_len < sizeof(raw))
+                raw[raw_len++] = c;
+            else
+                overflow = 1;
+            continue;
+        }
+
+        if (raw_len)
+        {
+            n = overflow ? 0 : Cobs_Decode(raw, raw_len, frame);
+            if (n >= 4 && n <= FRAME_MAX &&
+                Crc16(frame, n - 2) == (frame[n - 2] | frame[n - 1] << 8))
+                Link_Frame(frame[0], frame[1], frame + 2, n - 4);
+            else
+                link_bad++;
+        }
+        raw_len  = 0;
+        overflow = 0;
+    }
+}
+
+/* ================= STATE REPORT ================= */
+void LED_Report(void)
+{
+    uint8_t led = (GPIOB_ODR & (1<<4)) ? 1 : 0;
+
+    Link_Send(T_LED, &led, 1);
+}
+
+/* ================= COMMANDS ================= */
+uint8_t cmd_last_seq;
+uint8_t cmd_last_status;
+uint8_t cmd_seen;                     // cmd_last_seq is valid
+
+void Link_Ack(uint8_t seq, uint8_t status)
+{
+    uint8_t body[2] = { seq, status };
+
+    Link_Send(T_ACK, body, 2);
+}
+
+void Link_Frame(uint8_t seq, uint8_t type, const uint8_t *body, uint8_t len)
+{
+    uint8_t status = ACK_OK;
+
+    if (type == T_SYNC)
+    {
+        cmd_seen = 0;                     // new session: any seq is new
+        Link_Ack(seq, ACK_OK);
+        return;
+    }
+
+    if (type != T_CMD || (len & 1))
+        return;
+
+    if (cmd_seen && seq == cmd_last_seq)
+    {
+        Link_Ack(seq, cmd_last_status);   // our ack was lost
+        LED_Report();
+        return;
+    }
+
+    for (uint8_t i = 0; i < len; i += 2)
+    {
+        if (body[i] == OP_LED && body[i + 1])
+            GPIOB_ODR |= (1<<4);
+        else if (body[i] == OP_LED)
+            GPIOB_ODR &= ~(1<<4);
+        else if (body[i] != OP_QUERY)
+            status = ACK_BAD_OP;
+    }
+
+    cmd_seen        = 1;
+    cmd_last_seq    = seq;
+    cmd_last_status = status;
+
+    /* Ack and state first, the slow debug print after */
+    Link_Ack(seq, status);
+    LED_Report();
+
+    UART2_SendString((GPIOB_ODR & (1<<4)) ? "LED ON\r\n" : "LED OFF\r\n");
+}
+
+/* ================= TELEMETRY ================= */
+/* T_TELEM every TELEMETRY_MS: 14 bytes on the wire at 10 Hz */
+#define TELEMETRY_MS  100
+
+void Telemetry_Poll(void)
+{
+    static uint32_t last_ms = 0;
+    uint8_t body[7];
+    uint32_t t = ms_ticks;
+    int16_t temp;
+
+    /* Skip a period rather than queue behind a backlog */
+    if (t - last_ms < TELEMETRY_MS || UART3_TxFree() < FRAME_WIRE)
+        return;
+    last_ms = t;
+
+    temp = Temp_Read_x10();
+    body[0] = t;
+    body[1] = t >> 8;
+    body[2] = t >> 16;
+    body[3] = t >> 24;
+    body[4] = temp;
+    body[5] = temp >> 8;
+    body[6] = (GPIOB_ODR & (1<<4)) ? 1 : 0;
+
+    Link_Send(T_TELEM, body, sizeof(body));
+}
+
 /* ================= MAIN ================= */
 int main(void)
 {
     GPIO_Init();
+    SysTick_Init();
     UART2_Init();
     UART3_Init();
+    ADC_Init();
 
     UART2_SendString("STM32 READY\r\n");
+    UART3_Write((const uint8_t *)"", 1);   // 0x00: ends any partial frame
+    LED_Report();
 
     while (1)
     {
-        char c = UART3_Read();
-
-        UART2_SendString("RX: ");
-        UART2_SendChar(c);
-        UART2_SendString("\r\n");
-
-        if (c == '1')
-        {
-            GPIOB_ODR |= (1<<4);
-            UART2_SendString("LED ON\r\n");
-        }
-        else if (c == '0')
-        {
-            GPIOB_ODR &= ~(1<<4);
-            UART2_SendString("LED OFF\r\n");
-        }
+        Link_Poll();
+        Telemetry_Poll();
     }
 }
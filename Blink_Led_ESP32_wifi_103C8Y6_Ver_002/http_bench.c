@@ -0,0 +1,140 @@
+/* ================= HOST BENCH: HTTP ROUTING ================= */
+/* Not part of the Keil project. Builds main.c on a PC with its main()
+   renamed and replays a 4-request browser capture through
+     - http_rx() and the route trie (HTTP ROUTES in main.c)
+     - the old loop: append to rx[300], three strstr() per byte
+   Only the parsers run, no register is touched.
+
+     gcc -O2 -Wno-pointer-to-int-cast http_bench.c -o http_bench
+     ./http_bench
+
+   The old loop as it was never cleared rx[] after a match, so the
+   stale "GET /on" fired again on every following byte. Here rx[] is
+   cleared on a match, which is the most the old code could have
+   done; without it the comparison would be meaningless. */
+#define main firmware_main
+#include "main.c"
+#undef main
+
+#include <stdio.h>
+#include <time.h>
+
+#define ROUNDS  20000
+
+static const char capture[] =
+    "GET / HTTP/1.1\r\n"
+    "Host: 192.168.1.50\r\n"
+    "Connection: keep-alive\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,*/*;q=0.8\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Accept-Language: en-US,en;q=0.9\r\n\r\n"
+    "GET /on HTTP/1.1\r\n"
+    "Host: 192.168.1.50\r\n"
+    "Connection: keep-alive\r\n"
+    "Referer: http://192.168.1.50/\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,*/*;q=0.8\r\n"
+    "Accept-Encoding: gzip, deflate\r\n\r\n"
+    "GET /off HTTP/1.1\r\n"
+    "Host: 192.168.1.50\r\n"
+    "Connection: keep-alive\r\n"
+    "Referer: http://192.168.1.50/on\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,*/*;q=0.8\r\n"
+    "Accept-Encoding: gzip, deflate\r\n\r\n"
+    "GET /favicon.ico HTTP/1.1\r\n"
+    "Host: 192.168.1.50\r\n"
+    "Connection: keep-alive\r\n"
+    "Referer: http://192.168.1.50/off\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36\r\n"
+    "Accept: image/avif,image/webp,*/*;q=0.8\r\n\r\n";
+
+static unsigned hits_root, hits_on, hits_off;
+
+static void bench_root(uint8_t link) { (void)link; hits_root++; }
+static void bench_on(uint8_t link)   { (void)link; hits_on++; }
+static void bench_off(uint8_t link)  { (void)link; hits_off++; }
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void run_trie(void)
+{
+    http_reset(0, 1);
+    for (const char *p = capture; *p; p++)
+        http_rx(0, *p);
+}
+
+static void run_strstr(void)
+{
+    static char rx[300];
+    unsigned idx = 0;
+
+    memset(rx, 0, sizeof(rx));
+    for (const char *p = capture; *p; p++)
+    {
+        rx[idx++] = *p;
+        if (idx >= sizeof(rx) - 1)
+            idx = 0;
+
+        if (strstr(rx, "GET /on"))
+            hits_on++;
+        else if (strstr(rx, "GET /off"))
+            hits_off++;
+        else if (strstr(rx, "GET / "))
+            hits_root++;
+        else
+            continue;
+
+        memset(rx, 0, sizeof(rx));
+        idx = 0;
+    }
+}
+
+static double bench(void (*run)(void), const char *name)
+{
+    double t0, ns;
+
+    hits_root = hits_on = hits_off = 0;
+    run();
+    printf("%-7s: / %u, /on %u, /off %u", name, hits_root, hits_on, hits_off);
+
+    t0 = now_ns();
+    for (int r = 0; r < ROUNDS; r++)
+        run();
+    ns = (now_ns() - t0) / ((double)ROUNDS * (sizeof(capture) - 1));
+
+    printf(", %.1f ns/byte\n", ns);
+    return ns;
+}
+
+int main(void)
+{
+    unsigned r, o, f;
+
+    http_route_add("/", bench_root);
+    http_route_add("/on", bench_on);
+    http_route_add("/off", bench_off);
+
+    printf("capture: %u bytes, 4 requests\n", (unsigned)(sizeof(capture) - 1));
+
+    bench(run_trie, "trie");
+    r = hits_root; o = hits_on; f = hits_off;
+    bench(run_strstr, "strstr");
+
+    /* Both must route the first pass the same: one hit per page */
+    if (r != ROUNDS + 1 || o != ROUNDS + 1 || f != ROUNDS + 1 ||
+        hits_root != r || hits_on != o || hits_off != f)
+    {
+        printf("FAILED: routes differ\n");
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
@@ -1,8 +1,12 @@
 #include <stdint.h>
 #include <string.h>
-#include <stdio.h>
+
+/* esp_at_shim.c builds this file on a PC: it defines HOST_SIM and
+   maps every register below onto simulated peripherals */
+#ifndef HOST_SIM
 
 /* ================= RCC ================= */
+#define RCC_AHBENR    (*(volatile uint32_t*)0x40021014)
 #define RCC_APB2ENR   (*(volatile uint32_t*)0x40021018)
 #define RCC_APB1ENR   (*(volatile uint32_t*)0x4002101C)
 
@@ -11,6 +15,7 @@
 #define GPIOB_CRL     (*(volatile uint32_t*)0x40010C00)
 #define GPIOB_CRH     (*(volatile uint32_t*)0x40010C04)
 #define GPIOB_ODR     (*(volatile uint32_t*)0x40010C0C)
+#define GPIOB_BSRR    (*(volatile uint32_t*)0x40010C10)
 
 /* ================= AFIO ================= */
 #define AFIO_MAPR     (*(volatile uint32_t*)0x40010004)
@@ -26,6 +31,229 @@
 #define USART3_DR     (*(volatile uint32_t*)0x40004804)
 #define USART3_BRR    (*(volatile uint32_t*)0x40004808)
 #define USART3_CR1    (*(volatile uint32_t*)0x4000480C)
+#define USART3_CR3    (*(volatile uint32_t*)0x40004814)
+
+/* ================= DMA1 (CH2 = USART3_TX, CH3 = USART3_RX) ================= */
+#define DMA1_ISR      (*(volatile uint32_t*)0x40020000)
+#define DMA1_IFCR     (*(volatile uint32_t*)0x40020004)
+#define DMA1_CCR2     (*(volatile uint32_t*)0x4002001C)
+#define DMA1_CNDTR2   (*(volatile uint32_t*)0x40020020)
+#define DMA1_CPAR2    (*(volatile uint32_t*)0x40020024)
+#define DMA1_CMAR2    (*(volatile uint32_t*)0x40020028)
+#define DMA1_CCR3     (*(volatile uint32_t*)0x40020030)
+#define DMA1_CNDTR3   (*(volatile uint32_t*)0x40020034)
+#define DMA1_CPAR3    (*(volatile uint32_t*)0x40020038)
+#define DMA1_CMAR3    (*(volatile uint32_t*)0x4002003C)
+
+/* ================= SYSTICK ================= */
+#define SYST_CSR      (*(volatile uint32_t*)0xE000E010)
+#define SYST_RVR      (*(volatile uint32_t*)0xE000E014)
+#define SYST_CVR      (*(volatile uint32_t*)0xE000E018)
+
+/* ================= NVIC ================= */
+#define NVIC_ISER0    (*(volatile uint32_t*)0xE000E100)
+#define NVIC_ISER1    (*(volatile uint32_t*)0xE000E104)
+
+#endif /* HOST_SIM */
+
+/* ================= CLOCK TREE ================= */
+/* Same selection as SetSysClockTo72() in system_stm32f10x.c:
+   HSE 8 MHz x PLL 9 = SYSCLK 72 MHz, AHB /1, APB1 /2, APB2 /1 */
+#define HSE_HZ        8000000UL
+#define SYSCLK_HZ     (HSE_HZ * 9)
+#define HCLK_HZ       (SYSCLK_HZ / 1)
+#define PCLK1_HZ      (HCLK_HZ / 2)       // APB1: USART2/3, I2C1
+#define PCLK2_HZ      (HCLK_HZ / 1)       // APB2: USART1, SPI1, ADC1
+
+/* USART, 16x oversampling: BRR = PCLK / baud, error in 0.1 % steps */
+#define USART_BRR(pclk, baud)   (((pclk) + (baud) / 2) / (baud))
+#define USART_REAL(pclk, baud)  ((pclk) / USART_BRR(pclk, baud))
+#define USART_ERR(pclk, baud)                                   \
+    ((USART_REAL(pclk, baud) > (baud) ?                         \
+      USART_REAL(pclk, baud) - (baud) :                         \
+      (baud) - USART_REAL(pclk, baud)) * 1000 / (baud))
+#define USART_CHECK(pclk, baud, name)                           \
+    _Static_assert(USART_BRR(pclk, baud) >= 16 &&               \
+                   USART_ERR(pclk, baud) <= 20,                 \
+                   name " baud rate out of tolerance")
+
+#define DEBUG_BAUD    115200
+#define ESP_BOOT_BAUD 115200              // ESP AT firmware default
+#define ESP_BAUD      921600               // after AT+UART_CUR, RTS/CTS on
+USART_CHECK(PCLK1_HZ, DEBUG_BAUD, "USART2");
+USART_CHECK(PCLK1_HZ, ESP_BOOT_BAUD, "USART3 boot");
+USART_CHECK(PCLK1_HZ, ESP_BAUD, "USART3");
+
+/* Define ESP_ECHO to copy every ESP byte to USART2. The echo blocks
+   at DEBUG_BAUD, 8x slower than the ESP link, so it is for bring-up
+   only: with it the RX ring fills and RTS holds the ESP back. */
+/* #define ESP_ECHO */
+
+#define STR_(x)       #x
+#define STR(x)        STR_(x)
+
+/* ================= ESP RX RING ================= */
+#define ESP_RX_SIZE   512                  // power of two
+#define ESP_RX_MASK   (ESP_RX_SIZE - 1)
+
+/* Flow control (USART3 RTS = PB14, CTS = PB13)
+   DMA always empties USART3_DR, so hardware RTSE would never stop the
+   ESP. RTS is driven from software by the ring fill instead:
+   fill >= HIGH_WATER -> RTS high (stop), fill <= LOW_WATER -> RTS low.
+   Fill is checked on every IDLE / half / full event, i.e. at least
+   every ESP_RX_SIZE / 2 bytes, so HIGH_WATER must leave that much
+   room plus what the ESP still sends after RTS rises. */
+#define ESP_RX_HIGH_WATER  192
+#define ESP_RX_LOW_WATER   64
+#define ESP_RTS_SLACK      32
+_Static_assert(ESP_RX_HIGH_WATER + ESP_RX_SIZE / 2 + ESP_RTS_SLACK < ESP_RX_SIZE,
+               "ESP_RX_HIGH_WATER too high for ESP_RX_SIZE");
+_Static_assert(ESP_RX_LOW_WATER < ESP_RX_HIGH_WATER, "RTS water marks swapped");
+
+volatile char     esp_rx_buf[ESP_RX_SIZE]; // written by DMA (circular)
+volatile uint16_t esp_rx_head = 0;         // DMA position, updated by ISRs
+uint16_t          esp_rx_tail = 0;         // consumer position
+
+/* ================= TYPED FORMAT ================= */
+/* Caller-owned output buffer; no heap, no static state, so every
+   task / ISR can format into its own buffer at the same time.
+   Output is always '\0' terminated and silently cut at the end.
+
+   Before (Keil AC6 build with sprintf, Listings/main.map and
+   Objects/main.htm of that build):
+     flash   9344 B total RO; C library 6822 B code + 266 B RO data,
+             of which 6479 B (53 members: _printf_*, btod, _fp_*...)
+             are reached only through sprintf.o
+     stack   sprintf 136 B max depth (sprintf -> _printf_char_common
+             -> __printf), send_page 192 B, main 512 B + Unknown
+   After (counted by hand, not yet rebuilt in Keil): sb_* is about
+   0.2 KB of code plus digits2[201], so flash drops by about 6 KB;
+   the deepest path is caller -> sb_i32 -> sb_u32 (tmp[11] plus
+   saved registers, about 32 B) -> sb_str (leaf), under 48 B below
+   the caller instead of 136 B. */
+typedef struct
+{
+    char *p;            // next free char
+    char *end;          // last char, kept for '\0'
+} strbuf_t;
+
+/* Hex argument with minimum digit count: HEX(v, 2) -> "0A" */
+typedef struct
+{
+    uint32_t v;
+    uint8_t  width;
+} hex_t;
+#define HEX(v, w)   ((hex_t){ (v), (w) })
+
+void sb_init(strbuf_t *sb, char *buf, uint32_t size)
+{
+    sb->p   = buf;
+    sb->end = buf + size - 1;
+    *buf    = '\0';
+}
+
+void sb_char(strbuf_t *sb, char c)
+{
+    if (sb->p < sb->end)
+        *sb->p++ = c;
+    *sb->p = '\0';
+}
+
+void sb_str(strbuf_t *sb, const char *s)
+{
+    while (*s && sb->p < sb->end)
+        *sb->p++ = *s++;
+    *sb->p = '\0';
+}
+
+/* "00".."99" pairs and / 100 by reciprocal: no divide instruction */
+const char digits2[201] =
+    "00010203040506070809" "10111213141516171819"
+    "20212223242526272829" "30313233343536373839"
+    "40414243444546474849" "50515253545556575859"
+    "60616263646566676869" "70717273747576777879"
+    "80818283848586878889" "90919293949596979899";
+#define DIV100(n)   ((uint32_t)(((uint64_t)(n) * 1374389535u) >> 37))
+
+void sb_u32(strbuf_t *sb, uint32_t v)
+{
+    char tmp[11];
+    char *p = tmp + sizeof(tmp);
+
+    *--p = '\0';
+    while (v >= 100)
+    {
+        uint32_t q = DIV100(v);
+        uint32_t r = (v - q * 100) * 2;
+
+        *--p = digits2[r + 1];
+        *--p = digits2[r];
+        v = q;
+    }
+    if (v >= 10)
+    {
+        *--p = digits2[v * 2 + 1];
+        *--p = digits2[v * 2];
+    }
+    else
+    {
+        *--p = '0' + v;
+    }
+    sb_str(sb, p);
+}
+
+void sb_i32(strbuf_t *sb, int32_t v)
+{
+    if (v < 0)
+    {
+        sb_char(sb, '-');
+        sb_u32(sb, 0u - (uint32_t)v);
+    }
+    else
+    {
+        sb_u32(sb, (uint32_t)v);
+    }
+}
+
+void sb_hex(strbuf_t *sb, hex_t h)
+{
+    int n = 8;
+
+    while (n > h.width && (h.v >> ((n - 1) * 4)) == 0)
+        n--;
+    while (n--)
+        sb_char(sb, "0123456789ABCDEF"[(h.v >> (n * 4)) & 0xF]);
+}
+
+/* Pick the writer from the argument's type at compile time.
+   An unsupported type (float, pointer, ...) is a compile error. */
+#define SB_PUT(sb, x) _Generic((x),                 \
+        char *:             sb_str,                 \
+        const char *:       sb_str,                 \
+        char:               sb_char,                \
+        signed char:        sb_i32,                 \
+        short:              sb_i32,                 \
+        int:                sb_i32,                 \
+        long:               sb_i32,                 \
+        unsigned char:      sb_u32,                 \
+        unsigned short:     sb_u32,                 \
+        unsigned int:       sb_u32,                 \
+        unsigned long:      sb_u32,                 \
+        hex_t:              sb_hex)(sb, x)
+
+/* SB_CAT(&sb, "Raw=", val, "\r\n") appends 1..8 arguments in order.
+   Note 'x' is an int in C and prints as a number; use "x". */
+#define SB_CAT(sb, ...)                                             \
+    do { SB_N(__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1)(sb, __VA_ARGS__); } while (0)
+#define SB_N(a, b, c, d, e, f, g, h, n, ...)  SB_CAT_##n
+#define SB_CAT_1(sb, a)       SB_PUT(sb, a)
+#define SB_CAT_2(sb, a, ...)  SB_PUT(sb, a); SB_CAT_1(sb, __VA_ARGS__)
+#define SB_CAT_3(sb, a, ...)  SB_PUT(sb, a); SB_CAT_2(sb, __VA_ARGS__)
+#define SB_CAT_4(sb, a, ...)  SB_PUT(sb, a); SB_CAT_3(sb, __VA_ARGS__)
+#define SB_CAT_5(sb, a, ...)  SB_PUT(sb, a); SB_CAT_4(sb, __VA_ARGS__)
+#define SB_CAT_6(sb, a, ...)  SB_PUT(sb, a); SB_CAT_5(sb, __VA_ARGS__)
+#define SB_CAT_7(sb, a, ...)  SB_PUT(sb, a); SB_CAT_6(sb, __VA_ARGS__)
+#define SB_CAT_8(sb, a, ...)  SB_PUT(sb, a); SB_CAT_7(sb, __VA_ARGS__)
 
 /* ================= DELAY ================= */
 void delay(volatile uint32_t d)
@@ -33,6 +261,21 @@ void delay(volatile uint32_t d)
     while (d--) __asm("nop");
 }
 
+/* ================= SYSTICK ================= */
+volatile uint32_t ms_ticks;               // AT timeouts
+
+void systick_init(void)
+{
+    SYST_RVR = HCLK_HZ / 1000 - 1;        // 1 ms
+    SYST_CVR = 0;
+    SYST_CSR = 7;                         // HCLK, TICKINT, ENABLE
+}
+
+void SysTick_Handler(void)
+{
+    ms_ticks++;
+}
+
 /* ================= UART2 DEBUG ================= */
 void uart2_init(void)
 {
@@ -43,7 +286,7 @@ void uart2_init(void)
     GPIOA_CRL |=  (0xB << 8);     // PA2 TX
     GPIOA_CRL |=  (0x4 << 12);    // PA3 RX
 
-    USART2_BRR = 0xEA6;           // 115200 @36MHz
+    USART2_BRR = USART_BRR(PCLK1_HZ, DEBUG_BAUD);
     USART2_CR1 |= (1<<13)|(1<<3)|(1<<2);
 }
 
@@ -67,16 +310,123 @@ void uart3_init(void)
     AFIO_MAPR &= ~(7 << 24);
     AFIO_MAPR |=  (2 << 24);              // Disable JTAG
 
-    GPIOB_CRH &= ~((0xF << 8) | (0xF << 12));
+    GPIOB_CRH &= ~((0xF << 8) | (0xF << 12) | (0xF << 20) | (0xF << 24));
     GPIOB_CRH |=  (0xB << 8);              // PB10 TX
     GPIOB_CRH |=  (0x4 << 12);             // PB11 RX
+    GPIOB_CRH |=  (0x4 << 20);             // PB13 CTS (input)
+    GPIOB_CRH |=  (0x3 << 24);             // PB14 RTS (GPIO push-pull)
+    GPIOB_BSRR =  (1 << (14 + 16));        // RTS low = ready to receive
+
+    /* Start at the ESP default, uart3_set_fast() switches later */
+    USART3_BRR = USART_BRR(PCLK1_HZ, ESP_BOOT_BAUD);
+
+    /* RX: DMA1 CH3 fills esp_rx_buf forever (circular) */
+    RCC_AHBENR |= (1 << 0);                // DMA1
+    DMA1_CCR3   = 0;
+    DMA1_CPAR3  = (uint32_t)&USART3_DR;
+    DMA1_CMAR3  = (uint32_t)esp_rx_buf;
+    DMA1_CNDTR3 = ESP_RX_SIZE;
+    DMA1_CCR3   = (1<<7)|(1<<5)|(1<<2)|(1<<1);  // MINC, CIRC, HTIE, TCIE
+    DMA1_CCR3  |= (1<<0);                  // EN
+
+    /* TX: DMA1 CH2, started per block by uart3_dma_send() */
+    DMA1_CCR2   = 0;
+    DMA1_CPAR2  = (uint32_t)&USART3_DR;
+
+    USART3_CR3 |= (1<<7)|(1<<6);           // DMAT, DMAR
+    USART3_CR1 |= (1<<13)|(1<<4)|(1<<3)|(1<<2);   // UE, IDLEIE, TE, RE
+
+    NVIC_ISER0 |= (1 << 13);               // DMA1_Channel3 (IRQ13)
+    NVIC_ISER1 |= (1 << 7);                // USART3 (IRQ39)
+}
+
+/* ESP now runs at ESP_BAUD: switch USART3 and enable CTS */
+void uart3_set_fast(void)
+{
+    while (!(USART3_SR & (1<<6)));         // TC: last byte gone
+    USART3_CR1 &= ~(1<<13);                // UE off while changing
+    USART3_BRR  = USART_BRR(PCLK1_HZ, ESP_BAUD);
+    USART3_CR3 |= (1<<9);                  // CTSE: ESP can pause our TX
+    USART3_CR1 |= (1<<13);
+}
+
+/* Bytes DMA has written that the consumer has not read yet */
+uint16_t esp_rx_fill(void)
+{
+    return (ESP_RX_SIZE - DMA1_CNDTR3 - esp_rx_tail) & ESP_RX_MASK;
+}
+
+/* Drive RTS from the ring fill (see ESP_RX_HIGH_WATER) */
+void esp_rts_update(void)
+{
+    uint16_t fill = esp_rx_fill();
+
+    if (fill >= ESP_RX_HIGH_WATER)
+        GPIOB_BSRR = (1 << 14);            // RTS high: ESP stops
+    else if (fill <= ESP_RX_LOW_WATER)
+        GPIOB_BSRR = (1 << (14 + 16));     // RTS low: ESP may send
+}
 
-    USART3_BRR = 0xEA6;                    // 115200
-    USART3_CR1 |= (1<<13)|(1<<3)|(1<<2);
+/* Publish everything DMA has written so far to the consumer */
+void esp_rx_update(void)
+{
+    esp_rx_head = (ESP_RX_SIZE - DMA1_CNDTR3) & ESP_RX_MASK;
+    esp_rts_update();
+}
+
+/* IDLE line: ESP finished a burst, hand it over as one chunk */
+void USART3_IRQHandler(void)
+{
+    if (USART3_SR & (1 << 4))              // IDLE
+    {
+        (void)USART3_DR;                   // SR then DR read clears IDLE
+        esp_rx_update();
+    }
+}
+
+/* Half / full ring: long bursts are handed over before they wrap */
+void DMA1_Channel3_IRQHandler(void)
+{
+    if (DMA1_ISR & ((1 << 10) | (1 << 9))) // HTIF3 | TCIF3
+    {
+        DMA1_IFCR = (1 << 8);              // CGIF3 clears all ch3 flags
+        esp_rx_update();
+    }
+}
+
+/* Returns 1 and one byte if the ring is not empty */
+int esp_rx_getc(char *c)
+{
+    if (esp_rx_tail == esp_rx_head)
+        return 0;
+
+    *c = esp_rx_buf[esp_rx_tail];
+    esp_rx_tail = (esp_rx_tail + 1) & ESP_RX_MASK;
+    esp_rts_update();
+    return 1;
+}
+
+/* DMA still feeding USART3_DR */
+int uart3_dma_busy(void)
+{
+    return (DMA1_CCR2 & (1<<0)) && DMA1_CNDTR2;
+}
+
+/* Whole block in one DMA transfer; p may point into flash */
+void uart3_dma_send(const char *p, uint16_t len)
+{
+    while (uart3_dma_busy());
+
+    DMA1_CCR2   = 0;
+    DMA1_IFCR   = (1 << 4);                // CGIF2
+    DMA1_CMAR2  = (uint32_t)p;
+    DMA1_CNDTR2 = len;
+    DMA1_CCR2   = (1<<7)|(1<<4)|(1<<0);    // MINC, DIR mem->USART, EN
 }
 
 void uart3_tx(char c)
 {
+    while (uart3_dma_busy());              // keep byte order
     while (!(USART3_SR & (1<<7)));
     USART3_DR = c;
 }
@@ -97,99 +447,660 @@ void gpio_init(void)
     GPIOB_ODR &= ~(1 << 4);       // LED OFF
 }
 
-/* ================= ESP RX HANDLER ================= */
-void esp_read_response(uint32_t timeout)
+/* ================= AT ENGINE ================= */
+/* Commands are queued and sent one at a time. ESP output is split
+   into lines as it arrives: a result line (OK, ERROR, FAIL, SEND OK,
+   SEND FAIL, ready) finishes the current command at once and calls
+   its callback, every other line goes to at_urc(). A command with no
+   result after timeout_ms finishes with AT_TIMEOUT.
+   at_poll() must be called from the main loop; it never blocks. */
+#define AT_Q_SIZE     8                    // power of two
+#define AT_Q_MASK     (AT_Q_SIZE - 1)
+#define AT_CMD_MAX    64
+#define AT_LINE_MAX   128
+
+enum { AT_OK, AT_ERROR, AT_FAIL, AT_TIMEOUT };
+
+typedef void (*at_done_t)(int result);
+
+typedef struct
+{
+    char        cmd[AT_CMD_MAX];
+    const char *data;            // sent after the '>' prompt, or 0
+    uint16_t    len;
+    uint16_t    timeout_ms;
+    uint8_t     wait_ready;      // AT+RST: done on "ready", not "OK"
+    at_done_t   done;
+} at_cmd_t;
+
+at_cmd_t at_q[AT_Q_SIZE];
+uint8_t  at_q_head, at_q_tail;   // at_q[at_q_tail] is the current one
+uint8_t  at_active;              // current command has been sent
+uint8_t  at_prompted;            // '>' seen, data sent
+uint32_t at_sent_ms;
+char     at_line[AT_LINE_MAX];
+uint8_t  at_line_len;
+
+void at_urc(const char *line);   // unsolicited lines, see MAIN
+int  ipd_rx(char c);             // +IPD payloads, see +IPD DEMUX
+
+/* Queue a command; data != 0 is sent when the ESP prompts '>'.
+   data must stay valid until the callback. Returns 0 if full. */
+int at_send_data(const char *cmd, const char *data, uint16_t len,
+                 uint16_t timeout_ms, at_done_t done)
+{
+    at_cmd_t *q;
+
+    if (((at_q_head + 1) & AT_Q_MASK) == at_q_tail)
+        return 0;
+
+    q = &at_q[at_q_head];
+    strncpy(q->cmd, cmd, AT_CMD_MAX - 1);
+    q->cmd[AT_CMD_MAX - 1] = '\0';
+    q->data       = data;
+    q->len        = len;
+    q->timeout_ms = timeout_ms;
+    q->wait_ready = (strncmp(cmd, "AT+RST", 6) == 0);
+    q->done       = done;
+
+    at_q_head = (at_q_head + 1) & AT_Q_MASK;
+    return 1;
+}
+
+int at_send(const char *cmd, uint16_t timeout_ms, at_done_t done)
+{
+    return at_send_data(cmd, 0, 0, timeout_ms, done);
+}
+
+/* Nothing queued and nothing waiting for a result */
+int at_idle(void)
 {
-    while (timeout--)
+    return !at_active && at_q_tail == at_q_head;
+}
+
+void at_finish(int result)
+{
+    at_done_t done = at_q[at_q_tail].done;
+
+    at_active = 0;
+    at_q_tail = (at_q_tail + 1) & AT_Q_MASK;   // free before callback
+    if (done)
+        done(result);
+}
+
+/* One complete line from the ESP (CR/LF stripped) */
+void at_line_done(void)
+{
+    at_cmd_t *q = &at_q[at_q_tail];
+
+    at_line[at_line_len] = '\0';
+    at_line_len = 0;
+    if (at_line[0] == '\0')
+        return;
+
+    if (at_active)
     {
-        if (USART3_SR & (1 << 5))   // RXNE
+        if (!strcmp(at_line, "SEND OK"))
         {
-            char c = USART3_DR;
-            uart2_tx(c);           // SHOW ESP OUTPUT ON PC
+            at_finish(AT_OK);
+            return;
+        }
+        if (!strcmp(at_line, "OK"))
+        {
+            /* CIPSEND says OK before '>', AT+RST before "ready" */
+            if (!q->data && !q->wait_ready)
+                at_finish(AT_OK);
+            return;
+        }
+        if (!strcmp(at_line, "ready") && q->wait_ready)
+        {
+            at_finish(AT_OK);
+            return;
+        }
+        if (!strcmp(at_line, "ERROR") || !strcmp(at_line, "SEND FAIL"))
+        {
+            at_finish(AT_ERROR);
+            return;
+        }
+        if (!strcmp(at_line, "FAIL"))
+        {
+            at_finish(AT_FAIL);
+            return;
         }
     }
+
+    at_urc(at_line);
 }
 
-/* ================= ESP AT COMMAND ================= */
-void esp_cmd(const char *cmd)
+/* Feed one received byte */
+void at_rx(char c)
 {
-    uart2_print("\r\n>> ");
-    uart2_print(cmd);        // show command
+    at_cmd_t *q = &at_q[at_q_tail];
 
-    uart3_print(cmd);        // send to ESP32
+    if (c == '\n')
+    {
+        at_line_done();
+        return;
+    }
+    if (c == '\r')
+        return;
+
+    /* "> " has no line end: send the payload as soon as it shows */
+    if (c == '>' && at_line_len == 0 && at_active && q->data && !at_prompted)
+    {
+        uart3_dma_send(q->data, q->len);
+        at_prompted = 1;
+        return;
+    }
+
+    if (at_line_len < AT_LINE_MAX - 1)
+        at_line[at_line_len++] = c;
+}
+
+void at_poll(void)
+{
+    char c;
+
+    while (esp_rx_getc(&c))
+    {
+#ifdef ESP_ECHO
+        uart2_tx(c);               // SHOW ESP OUTPUT ON PC
+#endif
+        if (!ipd_rx(c))
+            at_rx(c);
+    }
+
+    if (at_active && ms_ticks - at_sent_ms >= at_q[at_q_tail].timeout_ms)
+        at_finish(AT_TIMEOUT);
+
+    if (!at_active && at_q_tail != at_q_head)
+    {
+        uart2_print("\r\n>> ");
+        uart2_print(at_q[at_q_tail].cmd);
 
-    esp_read_response(2000000);   // <<< READ RESPONSE
+        at_line_len = 0;
+        at_prompted = 0;
+        at_sent_ms  = ms_ticks;
+        at_active   = 1;
+        uart3_print(at_q[at_q_tail].cmd);
+    }
 }
 
 /* ================= WEB PAGE ================= */
-const char webpage[] =
-"HTTP/1.1 200 OK\r\n"
-"Content-Type: text/html\r\n\r\n"
-"<html>"
-"<h2>STM32 LED Control</h2>"
-"<a href=\"/on\">LED ON</a><br>"
-"<a href=\"/off\">LED OFF</a>"
-"</html>";
+/* Every answer is laid out at compile time as one flash object: the
+   CIPSEND command with its length, then status line, headers and
+   body back to back. Both lengths are 4 digits computed from sizeof,
+   nothing is counted or formatted per request, and the response goes
+   to the ESP as a single DMA transfer straight from flash. The link id
+   ('0' in the command) is the only byte patched at send time. */
+typedef struct
+{
+    const char *cipsend;         // "AT+CIPSEND=0,LLLL\r\n"
+    const char *data;            // status line .. end of body
+    uint16_t    len;
+} http_page_t;
+
+#define HTTP_HEAD(status, type)                                     \
+    "HTTP/1.1 " status "\r\nContent-Type: " type "\r\nContent-Length:"
+#define HTTP_LEN(status, type, text)                                \
+    (sizeof(HTTP_HEAD(status, type)) - 1 + 4 + 4 + sizeof(text) - 1)
+#define CIPSEND_LINK  11         // index of the link id in the command
+
+/* n as 4 digits, zero-padded (CIPSEND) or space-padded (header OWS) */
+#define DEC4(n)                                                     \
+    '0' + (n) / 1000 % 10, '0' + (n) / 100 % 10,                    \
+    '0' + (n) / 10 % 10,   '0' + (n) % 10
+#define DEC4S(n)                                                    \
+    (n) >= 1000 ? '0' + (n) / 1000 % 10 : ' ',                      \
+    (n) >= 100  ? '0' + (n) / 100 % 10  : ' ',                      \
+    (n) >= 10   ? '0' + (n) / 10 % 10   : ' ',                      \
+    '0' + (n) % 10
 
-void send_page(void)
+#define HTTP_PAGE(name, status, type, text)                         \
+    const struct                                                    \
+    {                                                               \
+        char cmd[sizeof("AT+CIPSEND=0,") - 1];                      \
+        char cmd_len[4];                                            \
+        char cmd_end[sizeof("\r\n")];      /* keeps the '\0' */      \
+        char head[sizeof(HTTP_HEAD(status, type)) - 1];             \
+        char len[4];                                                \
+        char sep[4];                                                \
+        char body[sizeof(text) - 1];                                \
+    } name##_blob =                                                 \
+    {                                                               \
+        "AT+CIPSEND=0,", { DEC4(HTTP_LEN(status, type, text)) }, "\r\n", \
+        HTTP_HEAD(status, type), { DEC4S(sizeof(text) - 1) }, "\r\n\r\n", \
+        text                                                        \
+    };                                                              \
+    _Static_assert(sizeof(name##_blob) ==                           \
+                   sizeof("AT+CIPSEND=0,\r\n") + 4 +                \
+                   HTTP_LEN(status, type, text), #name " padded");  \
+    _Static_assert(HTTP_LEN(status, type, text) <= 2048,            \
+                   #name " too long for one CIPSEND");              \
+    const http_page_t name =                                        \
+        { name##_blob.cmd, name##_blob.head, HTTP_LEN(status, type, text) }
+
+HTTP_PAGE(page_index, "200 OK", "text/html",
+    "<html><head><link rel=\"stylesheet\" href=\"/style.css\"></head>"
+    "<h2>STM32 LED Control</h2>"
+    "<a href=\"/on\">LED ON</a><br>"
+    "<a href=\"/off\">LED OFF</a><br>"
+    "<a href=\"/status\">STATUS</a>"
+    "</html>");
+
+HTTP_PAGE(page_css, "200 OK", "text/css",
+    "body{font-family:sans-serif}a{display:inline-block;margin:4px}");
+
+HTTP_PAGE(page_led_on, "200 OK", "application/json", "{\"led\":1}");
+HTTP_PAGE(page_led_off, "200 OK", "application/json", "{\"led\":0}");
+
+HTTP_PAGE(page_404, "404 Not Found", "text/plain", "Not Found");
+
+/* ================= HTTP ROUTES ================= */
+/* Each ESP link (CIPMUX=1, ids 0..4) has its own request parser and
+   response queue, so several browsers can be served at once.
+   Request lines are matched while the bytes stream in, no buffer:
+   "GET /" at the start of a payload line, then the path walks a trie
+   built from the routes by http_route_add(). A byte costs one state
+   step plus a scan of the current node's siblings (one per distinct
+   next char), so the cost per byte does not grow with the request
+   length. The route fires on the ' ' or '?' that ends the path. */
+#define ESP_LINKS     5
+#define HTTP_NODES    48
+#define HTTP_ROUTES   8
+#define HTTP_RESP_Q   4                    // per link, power of two
+#define HTTP_RESP_MASK (HTTP_RESP_Q - 1)
+
+typedef void (*http_handler_t)(uint8_t link);
+
+typedef struct
 {
-    char buf[40];
-    int len = strlen(webpage);
+    char    c;
+    uint8_t child;               // first child, 0 = none
+    uint8_t next;                // next sibling, 0 = none
+    uint8_t route;               // route index + 1, 0 = not a route end
+} http_node_t;
+
+typedef struct
+{
+    uint8_t     state;           // request parser
+    uint8_t     pos;             // chars of "GET /" matched
+    uint8_t     node;            // trie node of the path so far
+    uint8_t     open;            // between <id>,CONNECT and <id>,CLOSED
+    uint8_t     gen;             // bumped on CONNECT / CLOSED
+    uint8_t     q_head, q_tail;
+    const http_page_t *q[HTTP_RESP_Q];
+} http_link_t;
+
+http_node_t    http_trie[HTTP_NODES] = { { '/', 0, 0, 0 } };   // [0] = "/"
+uint8_t        http_nodes = 1;
+http_handler_t http_route[HTTP_ROUTES];
+uint8_t        http_routes;
+http_link_t    http_link[ESP_LINKS];
+
+uint8_t http_busy;               // link + 1 of the CIPSEND in flight
+uint8_t http_busy_gen;
+uint8_t http_rr;                 // round-robin start for the next send
+
+enum { HTTP_LINE, HTTP_SKIP, HTTP_METHOD, HTTP_PATH, HTTP_NOMATCH };
+
+void http_not_found(uint8_t link);   // see PAGE HANDLERS
+
+/* Register a path ("/", "/on", ...). Returns 0 if the tables are full. */
+int http_route_add(const char *path, http_handler_t handler)
+{
+    uint8_t n = 0;               // root is the leading '/'
+
+    if (*path++ != '/' || http_routes >= HTTP_ROUTES)
+        return 0;
+
+    for (; *path; path++)
+    {
+        uint8_t k = http_trie[n].child;
+
+        while (k && http_trie[k].c != *path)
+            k = http_trie[k].next;
 
-    sprintf(buf, "AT+CIPSEND=0,%d\r\n", len);
-    esp_cmd(buf);
-    esp_cmd(webpage);
+        if (!k)
+        {
+            if (http_nodes >= HTTP_NODES)
+                return 0;
+            k = http_nodes++;
+            http_trie[k].c     = *path;
+            http_trie[k].next  = http_trie[n].child;
+            http_trie[n].child = k;
+        }
+        n = k;
+    }
+
+    http_route[http_routes] = handler;
+    http_trie[n].route = ++http_routes;
+    return 1;
+}
+
+/* Feed one payload byte of link 'id' */
+void http_rx(uint8_t id, char c)
+{
+    http_link_t *l = &http_link[id];
+
+    switch (l->state)
+    {
+    case HTTP_LINE:
+    case HTTP_SKIP:
+        if (c == '\n')
+            l->state = HTTP_LINE;
+        else if (c == 'G' && l->state == HTTP_LINE)
+        {
+            l->state = HTTP_METHOD;
+            l->pos   = 1;
+        }
+        else
+            l->state = HTTP_SKIP;
+        break;
+
+    case HTTP_METHOD:
+        if (c != "GET /"[l->pos])
+            l->state = (c == '\n') ? HTTP_LINE : HTTP_SKIP;
+        else if (++l->pos == 5)
+        {
+            l->state = HTTP_PATH;
+            l->node  = 0;
+        }
+        break;
+
+    case HTTP_PATH:
+        if (c == ' ' || c == '?')
+        {
+            l->state = HTTP_SKIP;
+            if (http_trie[l->node].route)
+                http_route[http_trie[l->node].route - 1](id);
+            else
+                http_not_found(id);
+        }
+        else
+        {
+            uint8_t k = http_trie[l->node].child;
+
+            while (k && http_trie[k].c != c)
+                k = http_trie[k].next;
+
+            if (k)
+                l->node = k;
+            else
+                l->state = (c == '\n') ? HTTP_LINE : HTTP_NOMATCH;
+        }
+        break;
+
+    default:                     // HTTP_NOMATCH: unknown path
+        if (c == ' ' || c == '?')
+        {
+            l->state = HTTP_SKIP;
+            http_not_found(id);
+        }
+        else if (c == '\n')
+            l->state = HTTP_LINE;
+        break;
+    }
+}
+
+/* <id>,CONNECT / <id>,CLOSED: fresh parser, queued answers dropped */
+void http_reset(uint8_t id, uint8_t open)
+{
+    http_link_t *l = &http_link[id];
+
+    l->state  = HTTP_LINE;
+    l->open   = open;
+    l->gen++;
+    l->q_tail = l->q_head;
+}
+
+/* Queue an answer on a link. Returns 0 if its queue is full. */
+int http_respond(uint8_t id, const http_page_t *page)
+{
+    http_link_t *l = &http_link[id];
+
+    if (((l->q_head + 1) & HTTP_RESP_MASK) == l->q_tail)
+        return 0;
+
+    l->q[l->q_head] = page;
+    l->q_head = (l->q_head + 1) & HTTP_RESP_MASK;
+    return 1;
+}
+
+void http_sent(int result)
+{
+    http_link_t *l = &http_link[http_busy - 1];
+
+    (void)result;                // failed answers are not retried
+    if (l->gen == http_busy_gen)
+        l->q_tail = (l->q_tail + 1) & HTTP_RESP_MASK;
+    http_busy = 0;
+}
+
+/* One CIPSEND in flight at a time, links served round-robin */
+void http_pump(void)
+{
+    char buf[sizeof("AT+CIPSEND=0,0000\r\n")];
+
+    if (http_busy)
+        return;
+
+    for (uint8_t i = 0; i < ESP_LINKS; i++)
+    {
+        uint8_t      id = (http_rr + i) % ESP_LINKS;
+        http_link_t *l  = &http_link[id];
+        const http_page_t *r = l->q[l->q_tail];
+
+        if (l->q_tail == l->q_head)
+            continue;
+
+        memcpy(buf, r->cipsend, sizeof(buf));
+        buf[CIPSEND_LINK] = '0' + id;
+        if (!at_send_data(buf, r->data, r->len, 5000, http_sent))
+            return;
+
+        http_busy     = id + 1;
+        http_busy_gen = l->gen;
+        http_rr       = id + 1;
+        return;
+    }
+}
+
+/* ================= +IPD DEMUX ================= */
+/* "+IPD,<id>,<len>:" at the start of a line is followed by exactly
+   <len> payload bytes for link <id>. Header and payload are taken out
+   of the stream here and the payload goes to that link's parser, so
+   request text can never look like an AT result. Bytes that only
+   started like a header are handed back to at_rx(). */
+enum { IPD_IDLE, IPD_ID, IPD_LEN, IPD_DATA };
+
+uint8_t  ipd_state = IPD_IDLE;
+uint8_t  ipd_pos;                // chars of "+IPD," matched
+uint8_t  ipd_sol = 1;            // at start of a line
+uint8_t  ipd_id;
+uint16_t ipd_len;
+
+/* Returns 1 if the byte was taken */
+int ipd_rx(char c)
+{
+    switch (ipd_state)
+    {
+    case IPD_IDLE:
+        if (c == "+IPD,"[ipd_pos] && (ipd_pos || ipd_sol))
+        {
+            if (++ipd_pos == 5)
+            {
+                ipd_pos   = 0;
+                ipd_id    = 0;
+                ipd_state = IPD_ID;
+            }
+            return 1;
+        }
+        for (uint8_t i = 0; i < ipd_pos; i++)
+            at_rx("+IPD,"[i]);
+        ipd_pos = 0;
+        ipd_sol = (c == '\n');
+        return 0;
+
+    case IPD_ID:
+        if (c >= '0' && c <= '9')
+        {
+            ipd_id = ipd_id * 10 + (c - '0');
+            return 1;
+        }
+        ipd_len   = 0;
+        ipd_state = (c == ',') ? IPD_LEN : IPD_IDLE;
+        ipd_sol   = 0;
+        return ipd_state != IPD_IDLE;
+
+    case IPD_LEN:
+        if (c >= '0' && c <= '9')
+        {
+            ipd_len = ipd_len * 10 + (c - '0');
+            return 1;
+        }
+        ipd_state = (c == ':' && ipd_len) ? IPD_DATA : IPD_IDLE;
+        return c == ':';
+
+    default:                     // IPD_DATA
+        if (ipd_id < ESP_LINKS)
+            http_rx(ipd_id, c);
+        if (--ipd_len == 0)
+        {
+            ipd_state = IPD_IDLE;
+            ipd_sol   = 1;
+        }
+        return 1;
+    }
+}
+
+/* ================= PAGE HANDLERS ================= */
+void route_root(uint8_t link)
+{
+    http_respond(link, &page_index);
+}
+
+void route_on(uint8_t link)
+{
+    GPIOB_ODR |= (1 << 4);
+    http_respond(link, &page_index);
+}
+
+void route_off(uint8_t link)
+{
+    GPIOB_ODR &= ~(1 << 4);
+    http_respond(link, &page_index);
+}
+
+void route_css(uint8_t link)
+{
+    http_respond(link, &page_css);
+}
+
+void route_status(uint8_t link)
+{
+    http_respond(link, (GPIOB_ODR & (1 << 4)) ? &page_led_on : &page_led_off);
+}
+
+void http_not_found(uint8_t link)
+{
+    http_respond(link, &page_404);
+}
+
+/* ================= ESP BRING-UP ================= */
+/* Each step is queued from the previous one's callback, so the next
+   command goes out as soon as the ESP answers. */
+void esp_fail(int result)
+{
+    if (result != AT_OK)
+        uart2_print("\r\nESP COMMAND FAILED\r\n");
+}
+
+void esp_server_up(int result)
+{
+    char buf[48];
+    strbuf_t sb;
+
+    if (result != AT_OK)
+    {
+        esp_fail(result);
+        return;
+    }
+
+    sb_init(&sb, buf, sizeof(buf));
+    SB_CAT(&sb, "\r\nWEB SERVER READY (", ms_ticks, " ms)\r\n");
+    uart2_print(buf);
+}
+
+void esp_joined(int result)
+{
+    if (result != AT_OK)
+    {
+        uart2_print("\r\nWIFI JOIN FAILED\r\n");
+        return;
+    }
+
+    at_send("AT+CIFSR\r\n", 2000, esp_fail);          // <<< IP APPEARS HERE
+    at_send("AT+CIPMUX=1\r\n", 1000, esp_fail);
+    at_send("AT+CIPSERVER=1,80\r\n", 2000, esp_server_up);
+}
+
+void esp_fast(int result)
+{
+    /* Raise the link to ESP_BAUD with RTS/CTS (flow control = 3) */
+    if (result == AT_OK)
+        uart3_set_fast();
+
+    at_send("AT+CWMODE=1\r\n", 1000, esp_fail);
+    at_send("AT+CWJAP=\"beaglebone\",\"12345678910\"\r\n", 20000, esp_joined);
+}
+
+void esp_alive(int result)
+{
+    if (result != AT_OK)
+    {
+        at_send("AT\r\n", 500, esp_alive);      // still booting, ask again
+        return;
+    }
+
+    at_send("AT+UART_CUR=" STR(ESP_BAUD) ",8,1,0,3\r\n", 1000, esp_fast);
 }
 
 /* ================= MAIN ================= */
-int main(void)
+/* Lines that are not a command result, e.g. "0,CONNECT",
+   "1,CLOSED", "WIFI GOT IP". Requests are routed by http_rx(). */
+void at_urc(const char *line)
 {
-    char rx[300];
-    int idx = 0;
+    if (line[0] >= '0' && line[0] < '0' + ESP_LINKS && line[1] == ',')
+    {
+        if (!strcmp(line + 2, "CONNECT"))
+            http_reset(line[0] - '0', 1);
+        else if (!strcmp(line + 2, "CLOSED"))
+            http_reset(line[0] - '0', 0);
+    }
+}
 
+int main(void)
+{
     gpio_init();
     uart2_init();
     uart3_init();
+    systick_init();
+
+    http_route_add("/", route_root);
+    http_route_add("/on", route_on);
+    http_route_add("/off", route_off);
+    http_route_add("/style.css", route_css);
+    http_route_add("/status", route_status);
 
     uart2_print("\r\nSTM32 BOOT\r\n");
 
     /* ESP32 INIT */
-    esp_cmd("AT\r\n");
-    esp_cmd("AT+CWMODE=1\r\n");
-    esp_cmd("AT+CWJAP=\"beaglebone\",\"12345678910\"\r\n");
-    esp_cmd("AT+CIFSR\r\n");          // <<< IP APPEARS HERE
-    esp_cmd("AT+CIPMUX=1\r\n");
-    esp_cmd("AT+CIPSERVER=1,80\r\n");
-
-    uart2_print("\r\nWEB SERVER READY\r\n");
+    at_send("AT\r\n", 500, esp_alive);
 
     while (1)
     {
-        if (USART3_SR & (1 << 5))
-        {
-            char c = USART3_DR;
-            uart2_tx(c);             // debug
-            rx[idx++] = c;
-
-            if (idx >= sizeof(rx)) idx = 0;
-
-            if (strstr(rx, "GET /on"))
-            {
-                GPIOB_ODR |= (1 << 4);
-                send_page();
-                idx = 0;
-            }
-            else if (strstr(rx, "GET /off"))
-            {
-                GPIOB_ODR &= ~(1 << 4);
-                send_page();
-                idx = 0;
-            }
-            else if (strstr(rx, "GET / "))
-            {
-                send_page();
-                idx = 0;
-            }
-        }
+        at_poll();
+        http_pump();
     }
 }
@@ -1,14 +1,35 @@
 #include <stdint.h>
+#include <string.h>
 
 /* ================= USER CONFIG ================= */
 #define WIFI_SSID   "beaglebone"
 #define WIFI_PASS   "12345678910"
+#ifndef SERVER_IP
 #define SERVER_IP   "192.168.1.103"
+#endif
+
+/* Uplink to SERVER_IP:
+   UPLINK_HTTP_BATCH - POST /batch every BATCH_N samples (port 8080)
+   UPLINK_STREAM     - CIPMODE=1 passthrough, one line per sample (8081)
+   UPLINK_UDP        - one datagram per sample, seq + timestamp (8082)
+   UPLINK_MQTT       - MQTT 3.1.1 publisher, QoS0 / QoS1 (1883) */
+#define UPLINK_HTTP_BATCH  0
+#define UPLINK_STREAM      1
+#define UPLINK_UDP         2
+#define UPLINK_MQTT        3
+#ifndef UPLINK_MODE
+#define UPLINK_MODE        UPLINK_HTTP_BATCH
+#endif
+
+/* esp_at_shim.c builds this file on a PC: it defines HOST_SIM and
+   maps every register below onto simulated peripherals */
+#ifndef HOST_SIM
 
 /* ================= RCC ================= */
 #define RCC_APB2ENR (*(volatile uint32_t*)0x40021018)
 #define RCC_APB1ENR (*(volatile uint32_t*)0x4002101C)
 #define RCC_CFGR    (*(volatile uint32_t*)0x40021004)
+#define RCC_AHBENR  (*(volatile uint32_t*)0x40021014)
 
 /* ================= GPIO ================= */
 #define GPIOA_CRL   (*(volatile uint32_t*)0x40010800)
@@ -25,6 +46,15 @@
 #define USART3_DR   (*(volatile uint32_t*)0x40004804)
 #define USART3_BRR  (*(volatile uint32_t*)0x40004808)
 #define USART3_CR1  (*(volatile uint32_t*)0x4000480C)
+#define USART3_CR3  (*(volatile uint32_t*)0x40004814)
+
+/* ================= DMA1 (CH2 = USART3_TX) ================= */
+#define DMA1_ISR    (*(volatile uint32_t*)0x40020000)
+#define DMA1_IFCR   (*(volatile uint32_t*)0x40020004)
+#define DMA1_CCR2   (*(volatile uint32_t*)0x4002001C)
+#define DMA1_CNDTR2 (*(volatile uint32_t*)0x40020020)
+#define DMA1_CPAR2  (*(volatile uint32_t*)0x40020024)
+#define DMA1_CMAR2  (*(volatile uint32_t*)0x40020028)
 
 /* ================= ADC ================= */
 #define ADC1_SR     (*(volatile uint32_t*)0x40012400)
@@ -34,14 +64,64 @@
 #define ADC1_SQR3   (*(volatile uint32_t*)0x40012434)
 #define ADC1_DR     (*(volatile uint32_t*)0x4001244C)
 
+/* ================= SYSTICK ================= */
+#define SYST_CSR    (*(volatile uint32_t*)0xE000E010)
+#define SYST_RVR    (*(volatile uint32_t*)0xE000E014)
+#define SYST_CVR    (*(volatile uint32_t*)0xE000E018)
+
 /* ================= NVIC ================= */
 #define NVIC_ISER0  (*(volatile uint32_t*)0xE000E100)
+#define NVIC_ISER1  (*(volatile uint32_t*)0xE000E104)
+
+#endif /* HOST_SIM */
+
+/* ================= CLOCK TREE ================= */
+/* Same selection as SetSysClockTo72() in system_stm32f10x.c:
+   HSE 8 MHz x PLL 9 = SYSCLK 72 MHz, AHB /1, APB1 /2, APB2 /1 */
+#define HSE_HZ        8000000UL
+#define SYSCLK_HZ     (HSE_HZ * 9)
+#define HCLK_HZ       (SYSCLK_HZ / 1)
+#define PCLK1_HZ      (HCLK_HZ / 2)       // APB1: USART2/3, I2C1
+#define PCLK2_HZ      (HCLK_HZ / 1)       // APB2: USART1, SPI1, ADC1
+
+/* USART, 16x oversampling: BRR = PCLK / baud, error in 0.1 % steps */
+#define USART_BRR(pclk, baud)   (((pclk) + (baud) / 2) / (baud))
+#define USART_REAL(pclk, baud)  ((pclk) / USART_BRR(pclk, baud))
+#define USART_ERR(pclk, baud)                                   \
+    ((USART_REAL(pclk, baud) > (baud) ?                         \
+      USART_REAL(pclk, baud) - (baud) :                         \
+      (baud) - USART_REAL(pclk, baud)) * 1000 / (baud))
+#define USART_CHECK(pclk, baud, name)                           \
+    _Static_assert(USART_BRR(pclk, baud) >= 16 &&               \
+                   USART_ERR(pclk, baud) <= 20,                 \
+                   name " baud rate out of tolerance")
+
+/* ADC: smallest ADCPRE (/2 /4 /6 /8) keeping ADCCLK <= 14 MHz */
+#define ADC_MAX_HZ    14000000UL
+#define ADCPRE_BITS   (PCLK2_HZ / 2 <= ADC_MAX_HZ ? 0 :         \
+                       PCLK2_HZ / 4 <= ADC_MAX_HZ ? 1 :         \
+                       PCLK2_HZ / 6 <= ADC_MAX_HZ ? 2 : 3)
+#define ADCCLK_HZ     (PCLK2_HZ / (2 * (ADCPRE_BITS + 1)))
+_Static_assert(ADCCLK_HZ <= ADC_MAX_HZ, "ADCCLK above 14 MHz");
+
+#define DEBUG_BAUD    9600
+#define ESP_BAUD      115200
+USART_CHECK(PCLK1_HZ, DEBUG_BAUD, "USART2");
+USART_CHECK(PCLK1_HZ, ESP_BAUD, "USART3");
 
 /* ================= GLOBALS ================= */
 volatile uint16_t adc_val;
 volatile uint8_t  adc_flag = 0;
 volatile uint8_t  inet_flag = 0;
 char msg[32];
+volatile uint32_t ms_ticks;
+
+/* ESP RX ring: filled by USART3_IRQHandler, read by AT_Poll() */
+#define ESP_RX_SIZE  256                 // power of two
+#define ESP_RX_MASK  (ESP_RX_SIZE - 1)
+volatile char     esp_rx_buf[ESP_RX_SIZE];
+volatile uint16_t esp_rx_head;           // written by ISR only
+uint16_t          esp_rx_tail;           // written by main only
 
 /* ================= DELAY ================= */
 void delay(int t)
@@ -49,6 +129,19 @@ void delay(int t)
     for (volatile int i = 0; i < t * 1000; i++);
 }
 
+/* ================= SYSTICK ================= */
+void SysTick_Init(void)
+{
+    SYST_RVR = HCLK_HZ / 1000 - 1;      // 1 ms
+    SYST_CVR = 0;
+    SYST_CSR = 7;                       // HCLK, TICKINT, ENABLE
+}
+
+void SysTick_Handler(void)
+{
+    ms_ticks++;
+}
+
 /* ================= UART2 (Docklight) ================= */
 void UART2_Init(void)
 {
@@ -61,7 +154,7 @@ void UART2_Init(void)
     GPIOA_CRL &= ~(0xF<<12);
     GPIOA_CRL |=  (0x4<<12);
 
-    USART2_BRR = 0xEA6;
+    USART2_BRR = USART_BRR(PCLK1_HZ, DEBUG_BAUD);
     USART2_CR1 |= (1<<13)|(1<<3)|(1<<2);
 }
 
@@ -88,12 +181,65 @@ void UART3_Init(void)
     GPIOB_CRL &= ~(0xF<<12);
     GPIOB_CRL |=  (0x4<<12);
 
-    USART3_BRR = 0x138; // 115200
-    USART3_CR1 |= (1<<13)|(1<<3)|(1<<2);
+    USART3_BRR = USART_BRR(PCLK1_HZ, ESP_BAUD);
+    USART3_CR1 |= (1<<13)|(1<<5)|(1<<3)|(1<<2);   // UE, RXNEIE, TE, RE
+    NVIC_ISER1 |= (1<<7);                         // USART3 (IRQ39)
+
+    /* TX: DMA1 CH2, started per block by UART3_DmaSend() */
+    RCC_AHBENR |= (1<<0);                         // DMA1
+    DMA1_CCR2   = 0;
+    DMA1_CPAR2  = (uint32_t)&USART3_DR;
+    USART3_CR3 |= (1<<7);                         // DMAT
+    NVIC_ISER0 |= (1<<12);                        // DMA1_Channel2 (IRQ12)
+}
+
+void USART3_IRQHandler(void)
+{
+    if (USART3_SR & (1<<5))
+    {
+        char c = USART3_DR;
+        uint16_t next = (esp_rx_head + 1) & ESP_RX_MASK;
+
+        if (next != esp_rx_tail)        // full: drop the byte
+        {
+            esp_rx_buf[esp_rx_head] = c;
+            esp_rx_head = next;
+        }
+    }
+}
+
+int ESP_GetChar(char *c)
+{
+    if (esp_rx_tail == esp_rx_head)
+        return 0;
+
+    *c = esp_rx_buf[esp_rx_tail];
+    esp_rx_tail = (esp_rx_tail + 1) & ESP_RX_MASK;
+    return 1;
+}
+
+/* DMA still feeding USART3_DR */
+int UART3_DmaBusy(void)
+{
+    return (DMA1_CCR2 & (1<<0)) && DMA1_CNDTR2;
+}
+
+/* Whole block in one DMA transfer, TC interrupt when the last byte
+   has been handed to USART3 (see DMA1_Channel2_IRQHandler) */
+void UART3_DmaSend(const char *p, uint16_t len)
+{
+    while (UART3_DmaBusy());
+
+    DMA1_CCR2   = 0;
+    DMA1_IFCR   = (1<<4);                         // CGIF2
+    DMA1_CMAR2  = (uint32_t)p;
+    DMA1_CNDTR2 = len;
+    DMA1_CCR2   = (1<<7)|(1<<4)|(1<<1)|(1<<0);    // MINC, DIR mem->USART, TCIE, EN
 }
 
 void UART3_SendChar(char c)
 {
+    while (UART3_DmaBusy());                      // keep byte order
     while (!(USART3_SR & (1<<7)));
     USART3_DR = c;
 }
@@ -103,23 +249,127 @@ void UART3_SendString(char *s)
     while (*s) UART3_SendChar(*s++);
 }
 
-/* ================= INT TO STR ================= */
-void int_to_str(uint16_t v, char *b)
+/* ================= FAST FORMAT ================= */
+/* Division-free: 2 digits per step from digits2[], / 100 done as
+   a multiply-shift reciprocal. All return a pointer to the '\0'. */
+/* "00".."99": one table read emits two digits */
+const char digits2[201] =
+    "00010203040506070809" "10111213141516171819"
+    "20212223242526272829" "30313233343536373839"
+    "40414243444546474849" "50515253545556575859"
+    "60616263646566676869" "70717273747576777879"
+    "80818283848586878889" "90919293949596979899";
+
+/* n / 100 as multiply + shift, exact for every uint32_t */
+#define DIV100(n)   ((uint32_t)(((uint64_t)(n) * 1374389535u) >> 37))
+
+/* Unsigned decimal. Writes '\0', returns pointer to it */
+char *fmt_u32(char *buf, uint32_t v)
 {
-    int i=0, j=0; char t[6];
-    if(v==0) b[i++]='0';
-    else {
-        while(v){ t[j++]=(v%10)+'0'; v/=10; }
-        while(j) b[i++]=t[--j];
+    char tmp[10];
+    char *p = tmp + sizeof(tmp);
+
+    while (v >= 100)
+    {
+        uint32_t q = DIV100(v);
+        uint32_t r = (v - q * 100) * 2;
+
+        *--p = digits2[r + 1];
+        *--p = digits2[r];
+        v = q;
+    }
+
+    if (v >= 10)
+    {
+        *--p = digits2[v * 2 + 1];
+        *--p = digits2[v * 2];
+    }
+    else
+    {
+        *--p = '0' + v;
+    }
+
+    while (p < tmp + sizeof(tmp))
+        *buf++ = *p++;
+    *buf = '\0';
+    return buf;
+}
+
+/* Signed decimal */
+char *fmt_i32(char *buf, int32_t v)
+{
+    if (v < 0)
+    {
+        *buf++ = '-';
+        return fmt_u32(buf, 0u - (uint32_t)v);
     }
-    b[i]=0;
+    return fmt_u32(buf, (uint32_t)v);
+}
+
+/* Upper-case hex, at least 'width' digits (1..8) */
+char *fmt_hex32(char *buf, uint32_t v, int width)
+{
+    int n = 8;
+
+    while (n > width && (v >> ((n - 1) * 4)) == 0)
+        n--;
+
+    while (n--)
+        *buf++ = "0123456789ABCDEF"[(v >> (n * 4)) & 0xF];
+    *buf = '\0';
+    return buf;
+}
+
+/* Fixed point: v holds value x 10^dec, e.g. (1234, 2) -> "12.34".
+   Digits come from fmt_u32, the point is inserted, no divide.
+   dec is clamped to 0..FMT_DEC_MAX: an int32 has at most 10 digits,
+   so tmp[] never holds more than 10 plus the '\0' from fmt_u32. */
+#define FMT_DEC_MAX     9
+
+char *fmt_fixed(char *buf, int32_t v, int dec)
+{
+    char tmp[12];
+    int len, pad;
+
+    if (dec < 0)
+        dec = 0;
+    if (dec > FMT_DEC_MAX)
+        dec = FMT_DEC_MAX;
+
+    if (v < 0)
+    {
+        *buf++ = '-';
+        len = fmt_u32(tmp, 0u - (uint32_t)v) - tmp;
+    }
+    else
+    {
+        len = fmt_u32(tmp, (uint32_t)v) - tmp;
+    }
+
+    /* Leading zeros so there is one digit before the point */
+    for (pad = dec + 1 - len; pad > 0; pad--, len++)
+    {
+        for (int i = len; i > 0; i--)
+            tmp[i] = tmp[i - 1];
+        tmp[0] = '0';
+    }
+
+    for (int i = 0; i < len; i++)
+    {
+        if (dec && i == len - dec)
+            *buf++ = '.';
+        *buf++ = tmp[i];
+    }
+    *buf = '\0';
+    return buf;
 }
 
 /* ================= ADC ================= */
 void ADC_Init(void)
 {
     RCC_APB2ENR |= (1<<2)|(1<<9);
-    RCC_CFGR |= (2<<14);
+    RCC_CFGR &= ~(3<<14);
+    RCC_CFGR |= (ADCPRE_BITS<<14);
 
     GPIOA_CRL &= ~(0xF<<16);
     ADC1_SMPR2 |= (7<<12);
@@ -149,74 +399,1084 @@ void ADC1_2_IRQHandler(void)
     }
 }
 
+/* ================= AT ENGINE ================= */
+/* Commands are queued and sent one at a time. ESP output is split
+   into lines as it arrives: a result line (OK, ERROR, FAIL, SEND OK,
+   SEND FAIL, ready) finishes the current command at once and calls
+   its callback, every other line goes to AT_Urc(). A command with no
+   result after timeout_ms finishes with AT_TIMEOUT.
+   AT_Poll() must be called from the main loop; it never blocks. */
+#define AT_Q_SIZE     8                  // power of two
+#define AT_Q_MASK     (AT_Q_SIZE - 1)
+#define AT_CMD_MAX    80
+#define AT_LINE_MAX   128
+
+enum { AT_OK, AT_ERROR, AT_FAIL, AT_TIMEOUT };
+
+/* Payload of the current command: waiting for '>', on DMA, gone */
+enum { AT_DATA_WAIT, AT_DATA_DMA, AT_DATA_SENT };
+
+typedef void (*at_done_t)(int result);
+
+typedef struct
+{
+    char        cmd[AT_CMD_MAX];
+    const char *data;            // sent after the '>' prompt, or 0
+    uint16_t    len;
+    uint16_t    timeout_ms;
+    uint8_t     wait_ready;      // AT+RST: done on "ready", not "OK"
+    at_done_t   done;
+} at_cmd_t;
+
+at_cmd_t at_q[AT_Q_SIZE];
+uint8_t  at_q_head, at_q_tail;   // at_q[at_q_tail] is the current one
+uint8_t  at_active;              // current command has been sent
+volatile uint8_t at_prompted;    // see AT_DATA_*
+volatile uint32_t at_sent_ms;
+char     at_line[AT_LINE_MAX];
+uint8_t  at_line_len;
+uint8_t  at_passthru;            // CIPMODE=1 data phase: RX is not AT text
+
+void AT_Urc(const char *line);   // unsolicited lines, see CLOUD
+void AT_StreamRx(char c);        // passthrough RX, see CLOUD STREAM
+void AT_IpdData(char c);         // +IPD payload bytes, see CLOUD
+
+/* Queue a command; data != 0 is sent when the ESP prompts '>'.
+   data must stay valid until the callback. Returns 0 if full. */
+int AT_SendData(const char *cmd, const char *data, uint16_t len,
+                uint16_t timeout_ms, at_done_t done)
+{
+    at_cmd_t *q;
+
+    if (((at_q_head + 1) & AT_Q_MASK) == at_q_tail)
+        return 0;
+
+    q = &at_q[at_q_head];
+    strncpy(q->cmd, cmd, AT_CMD_MAX - 1);
+    q->cmd[AT_CMD_MAX - 1] = '\0';
+    q->data       = data;
+    q->len        = len;
+    q->timeout_ms = timeout_ms;
+    q->wait_ready = (strncmp(cmd, "AT+RST", 6) == 0);
+    q->done       = done;
+
+    at_q_head = (at_q_head + 1) & AT_Q_MASK;
+    return 1;
+}
+
+int AT_Send(const char *cmd, uint16_t timeout_ms, at_done_t done)
+{
+    return AT_SendData(cmd, 0, 0, timeout_ms, done);
+}
+
+/* Nothing queued and nothing waiting for a result */
+int AT_Idle(void)
+{
+    return !at_active && at_q_tail == at_q_head;
+}
+
+void AT_Finish(int result)
+{
+    at_done_t done = at_q[at_q_tail].done;
+
+    at_active = 0;
+    at_q_tail = (at_q_tail + 1) & AT_Q_MASK;   // free before callback
+    if (done)
+        done(result);
+}
+
+/* One complete line from the ESP (CR/LF stripped) */
+void AT_LineDone(void)
+{
+    at_cmd_t *q = &at_q[at_q_tail];
+
+    at_line[at_line_len] = '\0';
+    at_line_len = 0;
+    if (at_line[0] == '\0')
+        return;
+
+    if (at_active)
+    {
+        if (!strcmp(at_line, "SEND OK"))
+        {
+            AT_Finish(AT_OK);
+            return;
+        }
+        if (!strcmp(at_line, "OK"))
+        {
+            /* CIPSEND says OK before '>', AT+RST before "ready" */
+            if (!q->data && !q->wait_ready)
+                AT_Finish(AT_OK);
+            return;
+        }
+        if (!strcmp(at_line, "ready") && q->wait_ready)
+        {
+            AT_Finish(AT_OK);
+            return;
+        }
+        if (!strcmp(at_line, "ERROR") || !strcmp(at_line, "SEND FAIL"))
+        {
+            AT_Finish(AT_ERROR);
+            return;
+        }
+        if (!strcmp(at_line, "FAIL"))
+        {
+            AT_Finish(AT_FAIL);
+            return;
+        }
+    }
+
+    AT_Urc(at_line);
+}
+
+/* Feed one received byte */
+void AT_Rx(char c)
+{
+    at_cmd_t *q = &at_q[at_q_tail];
+
+    if (c == '\n')
+    {
+        AT_LineDone();
+        return;
+    }
+    if (c == '\r')
+        return;
+
+    /* "> " has no line end: start the payload as soon as it shows.
+       DMA sends it (1.76 KB is ~150 ms at 115200), main goes on */
+    if (c == '>' && at_line_len == 0 && at_active && q->data &&
+        at_prompted == AT_DATA_WAIT)
+    {
+        at_prompted = AT_DATA_DMA;
+        UART3_DmaSend(q->data, q->len);
+        return;
+    }
+
+    if (at_line_len < AT_LINE_MAX - 1)
+        at_line[at_line_len++] = c;
+}
+
+/* Payload handed to USART3: the result timeout starts now */
+void DMA1_Channel2_IRQHandler(void)
+{
+    if (DMA1_ISR & (1<<5))                        // TCIF2
+    {
+        DMA1_IFCR = (1<<4);                       // CGIF2
+        DMA1_CCR2 = 0;
+        if (at_prompted == AT_DATA_DMA)
+        {
+            at_sent_ms  = ms_ticks;
+            at_prompted = AT_DATA_SENT;
+        }
+    }
+}
+
+/* "+IPD,<len>:" (CIPMUX=0) is followed by <len> bytes of server
+   data. They go to AT_IpdData() instead of the line matcher, so a
+   body like "OK" is never taken for an AT result. Bytes that only
+   started like a header go to AT_Rx(). Returns 1 if the byte was
+   taken. */
+enum { IPD_IDLE, IPD_LEN, IPD_DATA };
+
+uint8_t  ipd_state = IPD_IDLE;
+uint8_t  ipd_pos;                // chars of "+IPD," matched
+uint8_t  ipd_sol = 1;            // at start of a line
+uint16_t ipd_len;
+
+int AT_IpdRx(char c)
+{
+    switch (ipd_state)
+    {
+    case IPD_IDLE:
+        if (c == "+IPD,"[ipd_pos] && (ipd_pos || ipd_sol))
+        {
+            if (++ipd_pos == 5)
+            {
+                ipd_pos   = 0;
+                ipd_len   = 0;
+                ipd_state = IPD_LEN;
+            }
+            return 1;
+        }
+        for (uint8_t i = 0; i < ipd_pos; i++)
+            AT_Rx("+IPD,"[i]);
+        ipd_pos = 0;
+        ipd_sol = (c == '\n');
+        return 0;
+
+    case IPD_LEN:
+        if (c >= '0' && c <= '9')
+        {
+            ipd_len = ipd_len * 10 + (c - '0');
+            return 1;
+        }
+        ipd_state = (c == ':' && ipd_len) ? IPD_DATA : IPD_IDLE;
+        return c == ':';
+
+    default:                     // IPD_DATA
+        AT_IpdData(c);
+        if (--ipd_len == 0)
+        {
+            ipd_state = IPD_IDLE;
+            ipd_sol   = 1;
+        }
+        return 1;
+    }
+}
+
+void AT_Poll(void)
+{
+    char c;
+
+    while (ESP_GetChar(&c))
+    {
+        if (at_passthru)
+            AT_StreamRx(c);
+        else if (!AT_IpdRx(c))
+            AT_Rx(c);
+    }
+
+    /* Passthrough: anything written to USART3 goes to the server */
+    if (at_passthru)
+        return;
+
+    /* Never while DMA still reads the payload the callback may reuse */
+    if (at_active && at_prompted != AT_DATA_DMA &&
+        ms_ticks - at_sent_ms >= at_q[at_q_tail].timeout_ms)
+        AT_Finish(AT_TIMEOUT);
+
+    if (!at_active && at_q_tail != at_q_head)
+    {
+        at_line_len = 0;
+        at_prompted = AT_DATA_WAIT;
+        at_sent_ms  = ms_ticks;
+        at_active   = 1;
+        UART3_SendString(at_q[at_q_tail].cmd);
+    }
+}
+
+/* ================= WI-FI SUPERVISOR ================= */
+/* inet_flag follows what the ESP reports: WIFI GOT IP sets it,
+   WIFI DISCONNECT clears it. While down, AT+CWJAP is retried with
+   exponential backoff, WIFI_RETRY_MIN_MS doubling up to
+   WIFI_RETRY_MAX_MS; if the ESP gets back on its own first, its
+   GOT IP ends the wait. Nothing here blocks, so sampling goes on
+   and the uplink buffers (see CLOUD SERVER) until GOT IP. */
+#define WIFI_RETRY_MIN_MS  1000
+#define WIFI_RETRY_MAX_MS  60000
+#define WIFI_JOIN_MS       20000
+
+enum { WIFI_OFF, WIFI_DOWN, WIFI_JOINING, WIFI_UP };
+
+uint8_t  wifi_state = WIFI_OFF;       // OFF until the ESP answers AT
+uint32_t wifi_backoff_ms = WIFI_RETRY_MIN_MS;
+uint32_t wifi_next_ms;                // next CWJAP not before this
+
+void Wifi_Up(void)
+{
+    if (wifi_state != WIFI_UP)
+        UART2_SendString("Wi-Fi up\r\n");
+
+    wifi_state      = WIFI_UP;
+    wifi_backoff_ms = WIFI_RETRY_MIN_MS;
+    inet_flag       = 1;
+}
+
+void Wifi_Down(void)
+{
+    inet_flag = 0;
+
+    /* A join in progress reports DISCONNECT first; its result decides */
+    if (wifi_state == WIFI_UP)
+    {
+        UART2_SendString("Wi-Fi down\r\n");
+        wifi_state   = WIFI_DOWN;
+        wifi_next_ms = ms_ticks + wifi_backoff_ms;
+    }
+}
+
+void Wifi_Joined(int result)
+{
+    if (result == AT_OK)
+    {
+        Wifi_Up();
+        return;
+    }
+
+    UART2_SendString("Wi-Fi join failed\r\n");
+    wifi_state   = WIFI_DOWN;
+    wifi_next_ms = ms_ticks + wifi_backoff_ms;
+
+    wifi_backoff_ms *= 2;
+    if (wifi_backoff_ms > WIFI_RETRY_MAX_MS)
+        wifi_backoff_ms = WIFI_RETRY_MAX_MS;
+}
+
+void Wifi_Start(void)
+{
+    if (wifi_state == WIFI_OFF)
+    {
+        wifi_state   = WIFI_DOWN;
+        wifi_next_ms = ms_ticks;
+    }
+}
+
+void Wifi_Supervisor(void)
+{
+    if (wifi_state != WIFI_DOWN || (int32_t)(ms_ticks - wifi_next_ms) < 0)
+        return;
+    if (at_passthru || !AT_Idle())    // stream leaves passthrough first
+        return;
+
+    if (AT_Send("AT+CWJAP=\"" WIFI_SSID "\",\"" WIFI_PASS "\"\r\n",
+                WIFI_JOIN_MS, Wifi_Joined))
+        wifi_state = WIFI_JOINING;
+}
+
 /* ================= ESP INIT ================= */
+/* Each step is queued from the previous one's callback, so the next
+   command goes out as soon as the ESP answers. */
+void ESP_Step(int result)
+{
+    if (result != AT_OK)
+        UART2_SendString("ESP command failed\r\n");
+}
+
+void ESP_Alive(int result)
+{
+    if (result != AT_OK)
+    {
+        AT_Send("AT\r\n", 500, ESP_Alive);     // still booting, ask again
+        return;
+    }
+
+    AT_Send("AT+CWMODE=1\r\n", 1000, ESP_Step);
+    AT_Send("AT+CIPMUX=0\r\n", 1000, ESP_Step);
+    Wifi_Start();
+}
+
 void ESP_Init(void)
 {
     UART2_SendString("ESP Init...\r\n");
+    AT_Send("AT\r\n", 500, ESP_Alive);
+}
+
+/* ================= CLOUD SERVER (BAREMETAL) ================= */
+/* One keep-alive HTTP/1.1 session to SERVER_IP:8080. The pot is
+   sampled every SAMPLE_PERIOD_MS into a ring of (t_ms, pot); once
+   BATCH_N are queued they go to POST /batch as "t_ms,pot\n" lines in
+   a single CIPSEND with an exact Content-Length. Sampling goes on
+   while Wi-Fi or the server is away: the ring holds OFFLINE_N samples
+   (~51 s), and when the link is back the backlog goes out BULK_N per
+   request. Samples leave the ring only after SEND OK, so a failed
+   request is rebuilt and resent. New samples are dropped (counted in
+   batch_drops) when the ring is full. */
+#define SAMPLE_PERIOD_MS  100
+#define BATCH_N           20          // post once this many are queued
+#define BULK_N            100         // most samples in one request
+#define BATCH_LINE_MAX    16          // "4294967295,100\n"
+#define HTTP_HDR_MAX      160
+#define OFFLINE_N         512         // power of two
+#define OFFLINE_MASK      (OFFLINE_N - 1)
+#define CLOUD_RETRY_MS    1000
 
-    UART3_SendString("AT\r\n");
-    delay(1000);
+/* Header up to the Content-Length digits; SERVER_IP may come from -D */
+#define BATCH_HDR   "POST /batch HTTP/1.1\r\n"                         \
+                    "Host: " SERVER_IP ":8080\r\n"                     \
+                    "Content-Type: text/csv\r\n"                       \
+                    "Content-Length: "
+_Static_assert(sizeof(BATCH_HDR "4294967295\r\n\r\n") <= HTTP_HDR_MAX,
+               "HTTP header does not fit hdr[]: raise HTTP_HDR_MAX");
 
-    UART3_SendString("AT+CWMODE=1\r\n");
-    delay(1000);
+uint32_t smp_t[OFFLINE_N];            // sample ring, main loop only
+uint8_t  smp_pot[OFFLINE_N];
+uint16_t smp_head, smp_tail;
+uint32_t batch_drops;                 // samples lost, ring full
 
-    UART3_SendString("AT+CWJAP=\"" WIFI_SSID "\",\"" WIFI_PASS "\"\r\n");
-    delay(6000);
+/* Body is written at http_req + HTTP_HDR_MAX, the header right in
+   front of it; http_data is where the request starts */
+char     http_req[HTTP_HDR_MAX + BULK_N * BATCH_LINE_MAX];
+char    *http_data;
+uint16_t http_len;                    // != 0: request waiting / in flight
+uint16_t http_n;                      // samples in it
+char     cipsend[24];
 
-    UART3_SendString("AT+CIPMUX=0\r\n");
-    delay(1000);
+uint8_t  cloud_up;                    // TCP link open
+uint8_t  cloud_busy;                  // CIPSTART or CIPSEND queued
+uint32_t cloud_retry_ms;
 
-    inet_flag = 1;  // Wi-Fi ready
-    UART2_SendString("ESP Ready\r\n");
+_Static_assert(sizeof(http_req) <= 2048, "CIPSEND takes at most 2048 bytes");
+
+/* Copy s to p, return pointer to the '\0' */
+char *Str_Append(char *p, const char *s)
+{
+    while (*s) *p++ = *s++;
+    *p = '\0';
+    return p;
+}
+
+uint16_t Cloud_Queued(void)
+{
+    return (smp_head - smp_tail) & OFFLINE_MASK;
+}
+
+void Cloud_Sample(void)
+{
+    static uint32_t last_ms = 0;
+
+    if (ms_ticks - last_ms < SAMPLE_PERIOD_MS)
+        return;
+    last_ms = ms_ticks;
+
+    if (Cloud_Queued() == OFFLINE_N - 1)
+    {
+        batch_drops++;
+        return;
+    }
+
+    smp_t[smp_head]   = ms_ticks;
+    smp_pot[smp_head] = (adc_val * 100) / 4095;
+    smp_head = (smp_head + 1) & OFFLINE_MASK;
+}
+
+/* Oldest (up to BULK_N) queued samples -> request in http_req */
+void Cloud_Build(void)
+{
+    char  hdr[HTTP_HDR_MAX];
+    char *body = http_req + HTTP_HDR_MAX;
+    char *p = body;
+    char *h;
+    uint16_t n = Cloud_Queued();
+
+    if (n > BULK_N)
+        n = BULK_N;
+
+    for (uint16_t i = 0; i < n; i++)
+    {
+        uint16_t k = (smp_tail + i) & OFFLINE_MASK;
+
+        p = fmt_u32(p, smp_t[k]);
+        *p++ = ',';
+        p = fmt_u32(p, smp_pot[k]);
+        *p++ = '\n';
+    }
+
+    h = Str_Append(hdr, BATCH_HDR);
+    h = fmt_u32(h, p - body);
+    h = Str_Append(h, "\r\n\r\n");
+
+    http_data = body - (h - hdr);
+    memcpy(http_data, hdr, h - hdr);
+    http_len = p - http_data;
+    http_n   = n;
+}
+
+void Cloud_Connected(int result)
+{
+    cloud_busy = 0;
+    if (result == AT_OK)
+        cloud_up = 1;                 // else "ALREADY CONNECTED" URC may set it
+}
+
+void Cloud_Sent(int result)
+{
+    cloud_busy = 0;
+
+    http_len = 0;                     // rebuilt from the ring next time
+
+    if (result != AT_OK)
+    {
+        cloud_up = 0;                 // reconnect, then resend
+        UART2_SendString("Cloud Failed\r\n");
+        return;
+    }
+
+    smp_tail = (smp_tail + http_n) & OFFLINE_MASK;
+    UART2_SendString("Cloud Sent: ");
+    fmt_u32(msg, http_n);
+    UART2_SendString(msg);
+    UART2_SendString(" samples\r\n");
 }
 
-/* ================= CLOUD SERVER (BAREMETAL) ================= */
 void Cloud_Server_BareMetal(void)
 {
-    static uint32_t rate_delay = 0;
-    char buf[10];
+    char *p;
+
+    Cloud_Sample();
+
+    if (!inet_flag || cloud_busy)
+        return;
 
-    if(rate_delay > 0)
+    if (!http_len && Cloud_Queued() >= BATCH_N)
+        Cloud_Build();
+
+    if (!http_len)
+        return;
+
+    if (!cloud_up)
     {
-        rate_delay--;
+        if (ms_ticks - cloud_retry_ms < CLOUD_RETRY_MS)
+            return;
+        cloud_retry_ms = ms_ticks;
+
+        if (AT_Send("AT+CIPSTART=\"TCP\",\"" SERVER_IP "\",8080\r\n", 5000, Cloud_Connected))
+            cloud_busy = 1;
         return;
     }
 
-    if((inet_flag == 1) && (adc_flag == 1))
+    p = Str_Append(cipsend, "AT+CIPSEND=");
+    p = fmt_u32(p, http_len);
+    Str_Append(p, "\r\n");
+
+    if (AT_SendData(cipsend, http_data, http_len, 5000, Cloud_Sent))
+        cloud_busy = 1;
+}
+
+/* ================= CLOUD STREAM (CIPMODE=1) ================= */
+/* UPLINK_MODE == UPLINK_STREAM: one TCP link to SERVER_IP:STREAM_PORT
+   in passthrough mode, so every sample is written straight to USART3
+   as a "t_ms,pot\n" line with no CIPSEND per packet.
+   Entering: CIPSTART, CIPMODE=1, CIPSEND (no length) -> '>'.
+   Leaving : the ESP only takes "+++" as escape when it is a packet on
+   its own, so STREAM_GUARD_MS of silence goes before and after it,
+   then CIPMODE=0 and CIPCLOSE in command mode.
+   While streaming, RX is server data; a "CLOSED" or "WIFI DISCONNECT"
+   line in it means the link is gone and starts the escape, after
+   which the link is reopened. */
+#define STREAM_PORT       "8081"
+#define STREAM_PERIOD_MS  10
+#define STREAM_GUARD_MS   1000
+#define STREAM_LINE_MAX   24
+
+enum { ST_IDLE, ST_OPENING, ST_STREAM, ST_ESC_PRE, ST_ESC_POST };
+
+uint8_t  stream_state = ST_IDLE;
+uint8_t  stream_lost;                  // set from AT_StreamRx()
+uint32_t stream_ms;                    // last sample / guard start
+char     stream_line[STREAM_LINE_MAX];
+uint8_t  stream_line_len;
+
+/* Passthrough RX: only watch for the link going away.
+   The CIPSEND '>' prompt comes after the OK that switched us here,
+   so it (and the space after it) would start the first line and hide
+   a "CLOSED" behind it: drop them at the start of a line. */
+void AT_StreamRx(char c)
+{
+    if (c == '\r')
+        return;
+
+    if (stream_line_len == 0 && (c == '>' || c == ' '))
+        return;
+
+    if (c != '\n')
     {
-        adc_flag = 0;
-        rate_delay = 2000;   // ~2 sec gap
+        if (stream_line_len < STREAM_LINE_MAX - 1)
+            stream_line[stream_line_len++] = c;
+        return;
+    }
 
-        uint16_t percent = (adc_val * 100) / 4095;
+    stream_line[stream_line_len] = '\0';
+    stream_line_len = 0;
 
-        UART3_SendString("AT+CIPSTART=\"TCP\",\"" SERVER_IP "\",8080\r\n");
-        delay(1500);
+    if (!strcmp(stream_line, "CLOSED") || !strcmp(stream_line, "WIFI DISCONNECT"))
+        stream_lost = 1;
+    if (!strncmp(stream_line, "WIFI ", 5))
+        AT_Urc(stream_line);          // keep the Wi-Fi supervisor informed
+}
 
-        UART3_SendString("AT+CIPSEND=100\r\n");
-        delay(500);
+void Stream_Started(int result)
+{
+    if (result != AT_OK)
+    {
+        AT_Send("AT+CIPMODE=0\r\n", 1000, 0);
+        AT_Send("AT+CIPCLOSE\r\n", 1000, 0);
+        stream_state = ST_IDLE;
+        return;
+    }
 
-        UART3_SendString("GET /page?pot=");
-        int_to_str(percent, buf);
-        UART3_SendString(buf);
-        UART3_SendString(" HTTP/1.1\r\n");
-        UART3_SendString("Host: " SERVER_IP "\r\n");
-        UART3_SendString("Connection: close\r\n\r\n");
+    /* '>' follows the OK: from here on USART3 is the TCP stream */
+    at_passthru     = 1;
+    stream_lost     = 0;
+    stream_line_len = 0;
+    stream_ms       = ms_ticks;
+    stream_state    = ST_STREAM;
+    UART2_SendString("Stream On\r\n");
+}
 
-        delay(1000);
-        UART3_SendString("AT+CIPCLOSE\r\n");
+void Stream_Connected(int result)
+{
+    if (result != AT_OK)
+    {
+        stream_state = ST_IDLE;
+        return;
+    }
+
+    AT_Send("AT+CIPMODE=1\r\n", 1000, 0);
+    AT_Send("AT+CIPSEND\r\n", 2000, Stream_Started);
+}
 
-        UART2_SendString("Cloud Sent: ");
-        UART2_SendString(buf);
-        UART2_SendString("\r\n");
+void Cloud_Stream(void)
+{
+    switch (stream_state)
+    {
+    case ST_IDLE:
+        if (!inet_flag || !AT_Idle() || ms_ticks - cloud_retry_ms < CLOUD_RETRY_MS)
+            return;
+        cloud_retry_ms = ms_ticks;
+
+        if (AT_Send("AT+CIPSTART=\"TCP\",\"" SERVER_IP "\"," STREAM_PORT "\r\n",
+                    5000, Stream_Connected))
+            stream_state = ST_OPENING;
+        break;
+
+    case ST_STREAM:
+        if (stream_lost)
+        {
+            UART2_SendString("Stream Lost\r\n");
+            stream_state = ST_ESC_PRE;     // stream_ms = last byte sent
+            break;
+        }
+
+        if (ms_ticks - stream_ms >= STREAM_PERIOD_MS)
+        {
+            char *p = msg;
+
+            stream_ms = ms_ticks;
+            p = fmt_u32(p, ms_ticks);
+            *p++ = ',';
+            p = fmt_u32(p, (adc_val * 100) / 4095);
+            Str_Append(p, "\n");
+            UART3_SendString(msg);
+        }
+        break;
+
+    case ST_ESC_PRE:
+        if (ms_ticks - stream_ms >= STREAM_GUARD_MS)
+        {
+            UART3_SendString("+++");
+            stream_ms    = ms_ticks;
+            stream_state = ST_ESC_POST;
+        }
+        break;
+
+    case ST_ESC_POST:
+        if (ms_ticks - stream_ms >= STREAM_GUARD_MS)
+        {
+            at_passthru = 0;               // back in command mode
+            AT_Send("AT+CIPMODE=0\r\n", 1000, 0);
+            AT_Send("AT+CIPCLOSE\r\n", 1000, 0);
+            cloud_retry_ms = ms_ticks;
+            stream_state   = ST_IDLE;
+        }
+        break;
+
+    default:                               // ST_OPENING: callbacks move on
+        break;
     }
 }
 
+/* ================= CLOUD UDP ================= */
+/* UPLINK_MODE == UPLINK_UDP: AT+CIPSTART="UDP" once, then one 10 byte
+   datagram per sample, no connection setup per reading:
+     seq u32 | t_ms u32 | raw u16          (little-endian)
+   seq only counts datagrams handed to the ESP, so a gap seen by
+   udp_receiver.py is network loss. Samples due while the previous
+   CIPSEND is still running are skipped and counted in udp_skipped. */
+#define UDP_PORT          "8082"
+#define UDP_PERIOD_MS     20
+
+uint8_t  udp_pkt[10];
+uint32_t udp_seq;
+uint32_t udp_skipped;
+uint32_t udp_ms;
+uint8_t  udp_up;
+uint8_t  udp_opening;
+
+void Put_U32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+void Udp_Opened(int result)
+{
+    udp_opening = 0;
+    udp_up = (result == AT_OK);
+}
+
+void Udp_Sent(int result)
+{
+    if (result != AT_OK)
+        udp_up = 0;                    // reopen after CLOUD_RETRY_MS
+}
+
+void Cloud_Udp(void)
+{
+    uint16_t raw;
+
+    if (!inet_flag || udp_opening)
+        return;
+
+    if (!udp_up)
+    {
+        if (!AT_Idle() || ms_ticks - cloud_retry_ms < CLOUD_RETRY_MS)
+            return;
+        cloud_retry_ms = ms_ticks;
+
+        AT_Send("AT+CIPCLOSE\r\n", 1000, 0);     // may ERROR, harmless
+        if (AT_Send("AT+CIPSTART=\"UDP\",\"" SERVER_IP "\"," UDP_PORT "\r\n",
+                    5000, Udp_Opened))
+            udp_opening = 1;
+        return;
+    }
+
+    if (ms_ticks - udp_ms < UDP_PERIOD_MS)
+        return;
+    udp_ms = ms_ticks;
+
+    if (!AT_Idle())
+    {
+        udp_skipped++;
+        return;
+    }
+
+    raw = adc_val;
+    Put_U32(udp_pkt, udp_seq++);
+    Put_U32(udp_pkt + 4, ms_ticks);
+    udp_pkt[8] = raw;
+    udp_pkt[9] = raw >> 8;
+
+    AT_SendData("AT+CIPSEND=10\r\n", (const char *)udp_pkt, sizeof(udp_pkt),
+                1000, Udp_Sent);
+}
+
+/* ================= CLOUD MQTT ================= */
+/* UPLINK_MODE == UPLINK_MQTT: MQTT 3.1.1 over one TCP link to
+   SERVER_IP:1883 (mqtt_broker.py next to this file stands in for a
+   broker). stm32/pot (percent) is published QoS0 every MQTT_PERIOD_MS
+   and stm32/adc (raw) QoS1 every MQTT_QOS1_MS. One QoS1 message is in
+   flight at a time; it is resent with DUP every MQTT_ACK_MS, also
+   across a reconnect, until its PUBACK arrives. PINGREQ goes out when
+   nothing else was sent for half the keep-alive. A missing CONNACK or
+   PINGRESP drops the link. Broker bytes come in through AT_IpdData(). */
+#define MQTT_PORT         "1883"
+#define MQTT_CLIENT_ID    "stm32-pot"
+#define MQTT_KEEPALIVE_S  60
+#define MQTT_PERIOD_MS    100
+#define MQTT_QOS1_MS      1000
+#define MQTT_ACK_MS       2000
+#define MQTT_PKT_MAX      48
+
+enum { MQ_IDLE, MQ_OPENING, MQ_CONNECTING, MQ_UP };
+
+uint8_t  mqtt_state = MQ_IDLE;
+uint8_t  mqtt_tx[MQTT_PKT_MAX];       // CONNECT / QoS0 / PINGREQ
+uint8_t  mqtt_q1[MQTT_PKT_MAX];       // QoS1 PUBLISH until its PUBACK
+uint8_t  mqtt_q1_len;
+uint16_t mqtt_q1_id;                  // 0 = none in flight
+uint16_t mqtt_next_id = 1;
+uint32_t mqtt_q1_ms;                  // last (re)send of mqtt_q1
+uint32_t mqtt_tx_ms;                  // last packet to the broker
+uint32_t mqtt_wait_ms;                // CONNECT / PINGREQ sent at
+uint8_t  mqtt_ping_wait;
+uint32_t mqtt_pot_ms;
+uint32_t mqtt_adc_ms;
+
+/* Broker -> STM32 packet being received */
+uint8_t  mqtt_rx[4];
+uint8_t  mqtt_rx_type;
+uint8_t  mqtt_rx_state;               // 0 type, 1 length, 2 body
+uint8_t  mqtt_rx_shift;
+uint8_t  mqtt_rx_n;
+uint32_t mqtt_rx_left;
+
+/* Fixed header, remaining length as 1..4 byte varint */
+uint8_t *Mqtt_Header(uint8_t *p, uint8_t type, uint32_t rem)
+{
+    *p++ = type;
+    do
+    {
+        *p = rem & 0x7F;
+        rem >>= 7;
+        if (rem)
+            *p |= 0x80;
+        p++;
+    } while (rem);
+    return p;
+}
+
+/* u16 length + bytes */
+uint8_t *Mqtt_Str(uint8_t *p, const char *s, uint16_t len)
+{
+    *p++ = len >> 8;
+    *p++ = len;
+    memcpy(p, s, len);
+    return p + len;
+}
+
+uint16_t Mqtt_Connect(uint8_t *buf)
+{
+    uint8_t *p;
+
+    p = Mqtt_Header(buf, 0x10, 10 + 2 + sizeof(MQTT_CLIENT_ID) - 1);
+    p = Mqtt_Str(p, "MQTT", 4);
+    *p++ = 4;                         // protocol level 3.1.1
+    *p++ = 0x02;                      // clean session
+    *p++ = MQTT_KEEPALIVE_S >> 8;
+    *p++ = MQTT_KEEPALIVE_S & 0xFF;
+    p = Mqtt_Str(p, MQTT_CLIENT_ID, sizeof(MQTT_CLIENT_ID) - 1);
+    return p - buf;
+}
+
+/* qos 0 or 1; id is only sent for qos 1. Topic + payload must fit
+   MQTT_PKT_MAX - 6. */
+uint16_t Mqtt_Publish(uint8_t *buf, const char *topic, const char *payload,
+                      uint8_t qos, uint16_t id)
+{
+    uint16_t tlen = strlen(topic);
+    uint16_t plen = strlen(payload);
+    uint8_t *p;
+
+    p = Mqtt_Header(buf, 0x30 | (qos << 1), 2 + tlen + (qos ? 2 : 0) + plen);
+    p = Mqtt_Str(p, topic, tlen);
+    if (qos)
+    {
+        *p++ = id >> 8;
+        *p++ = id;
+    }
+    memcpy(p, payload, plen);
+    return (p - buf) + plen;
+}
+
+void Mqtt_Drop(void)
+{
+    UART2_SendString("MQTT Down\r\n");
+    mqtt_state     = MQ_IDLE;
+    mqtt_rx_state  = 0;
+    mqtt_ping_wait = 0;
+    cloud_retry_ms = ms_ticks;
+    AT_Send("AT+CIPCLOSE\r\n", 1000, 0);
+}
+
+void Mqtt_Sent(int result)
+{
+    if (result != AT_OK && mqtt_state != MQ_IDLE)
+        Mqtt_Drop();
+}
+
+/* pkt must stay untouched until the '>' prompt has been answered */
+int Mqtt_Send(const uint8_t *pkt, uint16_t len)
+{
+    char *p;
+
+    p = Str_Append(cipsend, "AT+CIPSEND=");
+    p = fmt_u32(p, len);
+    Str_Append(p, "\r\n");
+
+    if (!AT_SendData(cipsend, (const char *)pkt, len, 2000, Mqtt_Sent))
+        return 0;
+    mqtt_tx_ms = ms_ticks;
+    return 1;
+}
+
+/* A whole packet from the broker is in */
+void Mqtt_Packet(void)
+{
+    mqtt_rx_state = 0;
+
+    switch (mqtt_rx_type >> 4)
+    {
+    case 2:                           // CONNACK: flags, return code
+        if (mqtt_state == MQ_CONNECTING && mqtt_rx_n == 2 && mqtt_rx[1] == 0)
+        {
+            mqtt_state = MQ_UP;
+            mqtt_q1_ms = ms_ticks - MQTT_ACK_MS;   // resend pending QoS1
+            UART2_SendString("MQTT Connected\r\n");
+        }
+        else if (mqtt_state == MQ_CONNECTING)
+            Mqtt_Drop();
+        break;
+
+    case 4:                           // PUBACK: packet id
+        if (mqtt_rx_n == 2 && ((mqtt_rx[0] << 8) | mqtt_rx[1]) == mqtt_q1_id)
+            mqtt_q1_id = 0;
+        break;
+
+    case 13:                          // PINGRESP
+        mqtt_ping_wait = 0;
+        break;
+
+    default:                          // nothing subscribed, ignore
+        break;
+    }
+}
+
+void Mqtt_Rx(uint8_t b)
+{
+    switch (mqtt_rx_state)
+    {
+    case 0:
+        mqtt_rx_type  = b;
+        mqtt_rx_left  = 0;
+        mqtt_rx_shift = 0;
+        mqtt_rx_n     = 0;
+        mqtt_rx_state = 1;
+        break;
+
+    case 1:
+        mqtt_rx_left |= (uint32_t)(b & 0x7F) << mqtt_rx_shift;
+        mqtt_rx_shift += 7;
+        if (!(b & 0x80))
+        {
+            if (mqtt_rx_left)
+                mqtt_rx_state = 2;
+            else
+                Mqtt_Packet();
+        }
+        break;
+
+    default:
+        if (mqtt_rx_n < sizeof(mqtt_rx))
+            mqtt_rx[mqtt_rx_n++] = b;
+        if (--mqtt_rx_left == 0)
+            Mqtt_Packet();
+        break;
+    }
+}
+
+void Mqtt_Opened(int result)
+{
+    uint16_t len;
+
+    if (result != AT_OK)
+    {
+        Mqtt_Drop();
+        return;
+    }
+
+    mqtt_rx_state = 0;
+    len = Mqtt_Connect(mqtt_tx);
+    Mqtt_Send(mqtt_tx, len);
+    mqtt_wait_ms = ms_ticks;
+    mqtt_state   = MQ_CONNECTING;
+}
+
+void Cloud_Mqtt(void)
+{
+    uint16_t len;
+
+    if (!inet_flag)
+        return;
+
+    switch (mqtt_state)
+    {
+    case MQ_IDLE:
+        if (!AT_Idle() || ms_ticks - cloud_retry_ms < CLOUD_RETRY_MS)
+            return;
+        cloud_retry_ms = ms_ticks;
+
+        if (AT_Send("AT+CIPSTART=\"TCP\",\"" SERVER_IP "\"," MQTT_PORT "\r\n",
+                    5000, Mqtt_Opened))
+            mqtt_state = MQ_OPENING;
+        return;
+
+    case MQ_CONNECTING:
+        if (ms_ticks - mqtt_wait_ms >= MQTT_ACK_MS)
+            Mqtt_Drop();                  // no CONNACK
+        return;
+
+    case MQ_UP:
+        break;
+
+    default:                              // MQ_OPENING: Mqtt_Opened() next
+        return;
+    }
+
+    if (mqtt_ping_wait && ms_ticks - mqtt_wait_ms >= MQTT_ACK_MS)
+    {
+        Mqtt_Drop();                      // no PINGRESP
+        return;
+    }
+
+    /* mqtt_tx / mqtt_q1 are only rebuilt while nothing is queued */
+    if (!AT_Idle())
+        return;
+
+    if (mqtt_q1_id && ms_ticks - mqtt_q1_ms >= MQTT_ACK_MS)
+    {
+        mqtt_q1[0] |= 0x08;               // DUP
+        Mqtt_Send(mqtt_q1, mqtt_q1_len);
+        mqtt_q1_ms = ms_ticks;
+    }
+    else if (!mqtt_q1_id && ms_ticks - mqtt_adc_ms >= MQTT_QOS1_MS)
+    {
+        mqtt_adc_ms = ms_ticks;
+        mqtt_q1_id  = mqtt_next_id++;
+        if (!mqtt_next_id)
+            mqtt_next_id = 1;             // id 0 is not allowed
+
+        fmt_u32(msg, adc_val);
+        mqtt_q1_len = Mqtt_Publish(mqtt_q1, "stm32/adc", msg, 1, mqtt_q1_id);
+        Mqtt_Send(mqtt_q1, mqtt_q1_len);
+        mqtt_q1_ms = ms_ticks;
+    }
+    else if (ms_ticks - mqtt_pot_ms >= MQTT_PERIOD_MS)
+    {
+        mqtt_pot_ms = ms_ticks;
+        fmt_u32(msg, (adc_val * 100) / 4095);
+        len = Mqtt_Publish(mqtt_tx, "stm32/pot", msg, 0, 0);
+        Mqtt_Send(mqtt_tx, len);
+    }
+    else if (!mqtt_ping_wait && ms_ticks - mqtt_tx_ms >= MQTT_KEEPALIVE_S * 500UL)
+    {
+        mqtt_tx[0] = 0xC0;                // PINGREQ
+        mqtt_tx[1] = 0x00;
+        if (Mqtt_Send(mqtt_tx, 2))
+        {
+            mqtt_ping_wait = 1;
+            mqtt_wait_ms   = ms_ticks;
+        }
+    }
+}
+
+/* +IPD payload: only the MQTT uplink reads what the server sends */
+void AT_IpdData(char c)
+{
+    if (UPLINK_MODE == UPLINK_MQTT)
+        Mqtt_Rx(c);
+}
+
+/* Lines that are not a command result ("WIFI GOT IP", "CLOSED", ...) */
+void AT_Urc(const char *line)
+{
+    if (!strcmp(line, "WIFI GOT IP"))
+        Wifi_Up();
+    else if (!strcmp(line, "WIFI DISCONNECT"))
+    {
+        Wifi_Down();
+        cloud_up   = 0;
+        udp_up     = 0;
+        mqtt_state = MQ_IDLE;
+    }
+    else if (!strcmp(line, "CLOSED"))
+    {
+        cloud_up   = 0;
+        udp_up     = 0;
+        mqtt_state = MQ_IDLE;
+    }
+    else if (!strcmp(line, "ALREADY CONNECTED"))
+        cloud_up = 1;
+}
+
 
 /* ================= MAIN ================= */
 int main(void)
 {
     UART2_Init();
     UART3_Init();
+    SysTick_Init();
     ADC_Init();
     ESP_Init();
 
@@ -224,7 +1484,16 @@ int main(void)
 
     while(1)
     {
-        Cloud_Server_BareMetal();
-        delay(2000);
+        AT_Poll();
+        Wifi_Supervisor();
+
+        if (UPLINK_MODE == UPLINK_STREAM)
+            Cloud_Stream();
+        else if (UPLINK_MODE == UPLINK_UDP)
+            Cloud_Udp();
+        else if (UPLINK_MODE == UPLINK_MQTT)
+            Cloud_Mqtt();
+        else
+            Cloud_Server_BareMetal();
     }
 }
@@ -0,0 +1,101 @@
+import socket
+import struct
+import threading
+
+# Minimal MQTT 3.1.1 broker stand-in for UPLINK_MODE == UPLINK_MQTT.
+#
+#   python3 mqtt_broker.py [port]
+#
+# Answers CONNECT, PUBLISH QoS0/QoS1 (PUBACK) and PINGREQ, and prints
+# every message. Nothing is forwarded to subscribers; for a real setup
+# point SERVER_IP at mosquitto instead.
+
+HOST = "0.0.0.0"
+PORT = 1883
+
+CONNECT, CONNACK, PUBLISH, PUBACK = 1, 2, 3, 4
+PINGREQ, PINGRESP, DISCONNECT = 12, 13, 14
+
+
+def read_exact(conn, n):
+    data = b""
+    while len(data) < n:
+        chunk = conn.recv(n - len(data))
+        if not chunk:
+            raise EOFError
+        data += chunk
+    return data
+
+
+def read_packet(conn):
+    head = read_exact(conn, 1)[0]
+    length, shift = 0, 0
+    while True:
+        b = read_exact(conn, 1)[0]
+        length |= (b & 0x7F) << shift
+        shift += 7
+        if not b & 0x80:
+            break
+    return head, read_exact(conn, length)
+
+
+def client(conn, addr):
+    name = addr[0]
+    try:
+        while True:
+            head, body = read_packet(conn)
+            kind = head >> 4
+
+            if kind == CONNECT:
+                proto_len, = struct.unpack_from(">H", body)
+                level, flags, keepalive = struct.unpack_from(">BBH", body, 2 + proto_len)
+                id_len, = struct.unpack_from(">H", body, 6 + proto_len)
+                name = body[8 + proto_len:8 + proto_len + id_len].decode()
+                print("[%s] CONNECT level=%d keepalive=%ds" % (name, level, keepalive))
+                conn.sendall(bytes([CONNACK << 4, 2, 0, 0 if level == 4 else 1]))
+
+            elif kind == PUBLISH:
+                qos = (head >> 1) & 3
+                topic_len, = struct.unpack_from(">H", body)
+                topic = body[2:2 + topic_len].decode()
+                pos = 2 + topic_len
+                if qos:
+                    pid, = struct.unpack_from(">H", body, pos)
+                    pos += 2
+                payload = body[pos:].decode(errors="replace")
+                dup = " DUP" if head & 0x08 else ""
+                if qos:
+                    print("[%s] %s = %s (qos1 id=%d%s)" % (name, topic, payload, pid, dup))
+                    conn.sendall(bytes([PUBACK << 4, 2]) + struct.pack(">H", pid))
+                else:
+                    print("[%s] %s = %s" % (name, topic, payload))
+
+            elif kind == PINGREQ:
+                print("[%s] PINGREQ" % name)
+                conn.sendall(bytes([PINGRESP << 4, 0]))
+
+            elif kind == DISCONNECT:
+                break
+    except (EOFError, ConnectionError):
+        pass
+    print("[%s] gone" % name)
+    conn.close()
+
+
+def main():
+    import sys
+    port = int(sys.argv[1]) if len(sys.argv) > 1 else PORT
+
+    srv = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    srv.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    srv.bind((HOST, port))
+    srv.listen(4)
+    print("MQTT stand-in on port", port)
+
+    while True:
+        conn, addr = srv.accept()
+        threading.Thread(target=client, args=(conn, addr), daemon=True).start()
+
+
+if __name__ == "__main__":
+    main()
@@ -1,12 +1,57 @@
-from http.server import BaseHTTPRequestHandler, HTTPServer
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
 from urllib.parse import urlparse, parse_qs
+import socketserver
+import threading
 import time
 
 HOST = "0.0.0.0"
 PORT = 8080
+STREAM_PORT = 8081
 latest = "N/A"
 
+
+class StreamHandler(socketserver.StreamRequestHandler):
+    # UPLINK_STREAM: raw "t_ms,pot" lines over one TCP link (CIPMODE=1)
+    def handle(self):
+        global latest
+        print("[STREAM] connected", self.client_address[0])
+        for line in self.rfile:
+            try:
+                t_ms, pot = line.decode().strip().split(",")
+            except ValueError:
+                continue
+            latest = pot
+            print("[STM32] t=%s ms pot=%s %%" % (t_ms, pot))
+        print("[STREAM] closed")
+
+
 class Handler(BaseHTTPRequestHandler):
+    # Keep-alive: the STM32 holds one TCP session open for all batches
+    protocol_version = "HTTP/1.1"
+
+    def reply(self, code, body=b"", ctype=None):
+        self.send_response(code)
+        if ctype:
+            self.send_header("Content-type", ctype)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def do_POST(self):
+        global latest
+        body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+
+        if urlparse(self.path).path == "/batch":
+            # one "t_ms,pot" line per sample
+            rows = [l.split(",") for l in body.decode().split("\n") if l]
+            for t_ms, pot in rows:
+                print("[STM32] t=%s ms pot=%s %%" % (t_ms, pot))
+            if rows:
+                latest = rows[-1][1]
+            self.reply(200, b"OK")
+        else:
+            self.reply(404)
+
     def do_GET(self):
         global latest
         p = urlparse(self.path)
@@ -16,15 +61,10 @@ class Handler(BaseHTTPRequestHandler):
             if "pot" in q:
                 latest = q["pot"][0]
                 print("[STM32]", latest)
-            self.send_response(200)
-            self.end_headers()
-            self.wfile.write(b"OK")
+            self.reply(200, b"OK")
 
         elif p.path == "/page":
-            self.send_response(200)
-            self.send_header("Content-type","text/html")
-            self.end_headers()
-            self.wfile.write(f"""
+            self.reply(200, f"""
             <html>
             <head><meta http-equiv="refresh" content="2"></head>
             <body>
@@ -33,11 +73,14 @@ class Handler(BaseHTTPRequestHandler):
             <p>{time.strftime('%H:%M:%S')}</p>
             </body>
             </html>
-            """.encode())
+            """.encode(), "text/html")
 
         else:
-            self.send_response(404)
-            self.end_headers()
+            self.reply(404)
+
+socketserver.ThreadingTCPServer.allow_reuse_address = True
+stream = socketserver.ThreadingTCPServer((HOST, STREAM_PORT), StreamHandler)
+threading.Thread(target=stream.serve_forever, daemon=True).start()
 
-print("Server running on port", PORT)
-HTTPServer((HOST, PORT), Handler).serve_forever()
+print("Server running on port", PORT, "stream on", STREAM_PORT)
+ThreadingHTTPServer((HOST, PORT), Handler).serve_forever()
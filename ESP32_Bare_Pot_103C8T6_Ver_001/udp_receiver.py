@@ -0,0 +1,92 @@
+import socket
+import struct
+import time
+
+# Receiver for UPLINK_MODE == UPLINK_UDP in main.c.
+#
+#   python3 udp_receiver.py
+#
+# Datagram: seq u32 | t_ms u32 | raw u16 (little-endian, 10 bytes).
+# Every reading is appended to log.txt as "HH:MM:SS Pot=NN" and the
+# loss / reordering counts are printed every REPORT_S seconds.
+
+HOST = "0.0.0.0"
+PORT = 8082
+REPORT_S = 5
+
+PKT = struct.Struct("<IIH")
+
+
+class Stats:
+    def __init__(self):
+        self.reset()
+
+    def reset(self):
+        self.received = 0
+        self.reordered = 0       # arrived after a higher seq
+        self.duplicates = 0
+        self.next_seq = None     # highest seq seen + 1
+        self.missing = set()     # gaps not filled (yet)
+
+    def add(self, seq):
+        if self.next_seq is None:
+            self.next_seq = seq
+        if seq >= self.next_seq:
+            self.missing.update(range(self.next_seq, seq))
+            self.next_seq = seq + 1
+        elif seq in self.missing:
+            self.missing.discard(seq)
+            self.reordered += 1
+        else:
+            self.duplicates += 1
+            return
+        self.received += 1
+
+    def report(self):
+        sent = self.received + len(self.missing)
+        loss = 100.0 * len(self.missing) / sent if sent else 0.0
+        return ("rx %d  lost %d (%.2f %%)  reordered %d  dup %d"
+                % (self.received, len(self.missing), loss,
+                   self.reordered, self.duplicates))
+
+
+def main():
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind((HOST, PORT))
+    sock.settimeout(1.0)
+    print("UDP receiver on port", PORT)
+
+    stats = Stats()
+    last_t = None
+    next_report = time.time() + REPORT_S
+
+    with open("log.txt", "a") as log:
+        while True:
+            try:
+                data, _ = sock.recvfrom(64)
+            except socket.timeout:
+                data = None
+
+            if data and len(data) == PKT.size:
+                seq, t_ms, raw = PKT.unpack(data)
+
+                # Device restarted: seq and clock start again from 0
+                # (a reordered datagram is only a few ms behind)
+                if last_t is not None and seq < 16 and t_ms + 1000 < last_t:
+                    print("device restart, stats reset:", stats.report())
+                    stats.reset()
+                    last_t = None
+                last_t = t_ms if last_t is None else max(last_t, t_ms)
+
+                stats.add(seq)
+                log.write("%s Pot=%d\n" % (time.strftime("%H:%M:%S"),
+                                           raw * 100 // 4095))
+                log.flush()
+
+            if time.time() >= next_report:
+                next_report += REPORT_S
+                print(stats.report())
+
+
+if __name__ == "__main__":
+    main()
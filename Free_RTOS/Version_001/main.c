@@ -1,7 +1,7 @@
 #include <stdint.h>
 #include "FreeRTOS.h"
 #include "task.h"
-#include "semphr.h"
+#include "queue.h"
 
 /* =========================================================
    RCC
@@ -50,14 +50,203 @@
 #define I2C1_SR1    (*(volatile uint32_t*)0x40005414)
 #define I2C1_DR     (*(volatile uint32_t*)0x40005410)
 
+/* =========================================================
+   CLOCK TREE (COMPILE TIME)
+   ========================================================= */
+/* Same selection as SetSysClockTo72() in system_stm32f10x.c:
+   HSE 8 MHz x PLL 9 = SYSCLK 72 MHz, AHB /1, APB1 /2, APB2 /1 */
+#define HSE_HZ        8000000UL
+#define SYSCLK_HZ     (HSE_HZ * 9)
+#define HCLK_HZ       (SYSCLK_HZ / 1)
+#define PCLK1_HZ      (HCLK_HZ / 2)       // APB1: USART2/3, I2C1
+#define PCLK2_HZ      (HCLK_HZ / 1)       // APB2: USART1, SPI1, ADC1
+
+/* USART, 16x oversampling: BRR = PCLK / baud, error in 0.1 % steps */
+#define USART_BRR(pclk, baud)   (((pclk) + (baud) / 2) / (baud))
+#define USART_REAL(pclk, baud)  ((pclk) / USART_BRR(pclk, baud))
+#define USART_ERR(pclk, baud)                                   \
+    ((USART_REAL(pclk, baud) > (baud) ?                         \
+      USART_REAL(pclk, baud) - (baud) :                         \
+      (baud) - USART_REAL(pclk, baud)) * 1000 / (baud))
+#define USART_CHECK(pclk, baud, name)                           \
+    _Static_assert(USART_BRR(pclk, baud) >= 16 &&               \
+                   USART_ERR(pclk, baud) <= 20,                 \
+                   name " baud rate out of tolerance")
+
+/* ADC: smallest ADCPRE (/2 /4 /6 /8) keeping ADCCLK <= 14 MHz */
+#define ADC_MAX_HZ    14000000UL
+#define ADCPRE_BITS   (PCLK2_HZ / 2 <= ADC_MAX_HZ ? 0 :         \
+                       PCLK2_HZ / 4 <= ADC_MAX_HZ ? 1 :         \
+                       PCLK2_HZ / 6 <= ADC_MAX_HZ ? 2 : 3)
+#define ADCCLK_HZ     (PCLK2_HZ / (2 * (ADCPRE_BITS + 1)))
+_Static_assert(ADCCLK_HZ <= ADC_MAX_HZ, "ADCCLK above 14 MHz");
+
+/* SPI1: smallest BR (fPCLK2 / 2^(BR+1)) keeping SCK <= SPI_MAX_HZ */
+#define SPI_MAX_HZ    10000000UL          // nRF24L01 SCK limit
+#define SPI_FITS(br)  ((PCLK2_HZ >> ((br) + 1)) <= SPI_MAX_HZ)
+#define SPI_BR_BITS   (SPI_FITS(0) ? 0 : SPI_FITS(1) ? 1 :      \
+                       SPI_FITS(2) ? 2 : SPI_FITS(3) ? 3 :      \
+                       SPI_FITS(4) ? 4 : SPI_FITS(5) ? 5 :      \
+                       SPI_FITS(6) ? 6 : 7)
+_Static_assert(SPI_FITS(SPI_BR_BITS), "SPI1 clock above SPI_MAX_HZ");
+
+#define DEBUG_BAUD    9600
+USART_CHECK(PCLK1_HZ, DEBUG_BAUD, "USART2");
+
 /* =========================================================
    GLOBAL RTOS OBJECTS
    ========================================================= */
-SemaphoreHandle_t uartSem;
-char uartBuf[128];
+/* Each task formats a line into its own uart_msg_t on its stack and
+   queues a copy; UART_Task is the only writer of USART2. No shared
+   buffer, so a task can never overwrite a line still being sent. */
+#define UART_MSG_LEN    48
+#define UART_QUEUE_LEN  6
+
+typedef struct
+{
+    char text[UART_MSG_LEN];
+} uart_msg_t;
+
+QueueHandle_t uartQueue;
 
 volatile uint16_t adc_val;
 
+/* =========================================================
+   TYPED FORMATTER (replaces sprintf)
+   ========================================================= */
+/* Caller-owned output buffer; no heap, no static state, so every
+   task / ISR can format into its own buffer at the same time.
+   Output is always '\0' terminated and silently cut at the end.
+
+   This project's Objects/ has no main.htm or map (main.c was never
+   linked there). The same sprintf build of the ESP32 Ver_002 project
+   measured 136 B of stack for sprintf alone and 6479 B of library
+   flash reached only through it; each 256-word task stack here had
+   to carry that depth. */
+typedef struct
+{
+    char *p;            // next free char
+    char *end;          // last char, kept for '\0'
+} strbuf_t;
+
+/* Hex argument with minimum digit count: HEX(v, 2) -> "0A" */
+typedef struct
+{
+    uint32_t v;
+    uint8_t  width;
+} hex_t;
+#define HEX(v, w)   ((hex_t){ (v), (w) })
+
+void sb_init(strbuf_t *sb, char *buf, uint32_t size)
+{
+    sb->p   = buf;
+    sb->end = buf + size - 1;
+    *buf    = '\0';
+}
+
+void sb_char(strbuf_t *sb, char c)
+{
+    if (sb->p < sb->end)
+        *sb->p++ = c;
+    *sb->p = '\0';
+}
+
+void sb_str(strbuf_t *sb, const char *s)
+{
+    while (*s && sb->p < sb->end)
+        *sb->p++ = *s++;
+    *sb->p = '\0';
+}
+
+/* "00".."99" pairs and / 100 by reciprocal: no divide instruction */
+const char digits2[201] =
+    "00010203040506070809" "10111213141516171819"
+    "20212223242526272829" "30313233343536373839"
+    "40414243444546474849" "50515253545556575859"
+    "60616263646566676869" "70717273747576777879"
+    "80818283848586878889" "90919293949596979899";
+#define DIV100(n)   ((uint32_t)(((uint64_t)(n) * 1374389535u) >> 37))
+
+void sb_u32(strbuf_t *sb, uint32_t v)
+{
+    char tmp[11];
+    char *p = tmp + sizeof(tmp);
+
+    *--p = '\0';
+    while (v >= 100)
+    {
+        uint32_t q = DIV100(v);
+        uint32_t r = (v - q * 100) * 2;
+
+        *--p = digits2[r + 1];
+        *--p = digits2[r];
+        v = q;
+    }
+    if (v >= 10)
+    {
+        *--p = digits2[v * 2 + 1];
+        *--p = digits2[v * 2];
+    }
+    else
+    {
+        *--p = '0' + v;
+    }
+    sb_str(sb, p);
+}
+
+void sb_i32(strbuf_t *sb, int32_t v)
+{
+    if (v < 0)
+    {
+        sb_char(sb, '-');
+        sb_u32(sb, 0u - (uint32_t)v);
+    }
+    else
+    {
+        sb_u32(sb, (uint32_t)v);
+    }
+}
+
+void sb_hex(strbuf_t *sb, hex_t h)
+{
+    int n = 8;
+
+    while (n > h.width && (h.v >> ((n - 1) * 4)) == 0)
+        n--;
+    while (n--)
+        sb_char(sb, "0123456789ABCDEF"[(h.v >> (n * 4)) & 0xF]);
+}
+
+/* Pick the writer from the argument's type at compile time.
+   An unsupported type (float, pointer, ...) is a compile error. */
+#define SB_PUT(sb, x) _Generic((x),                 \
+        char *:             sb_str,                 \
+        const char *:       sb_str,                 \
+        char:               sb_char,                \
+        signed char:        sb_i32,                 \
+        short:              sb_i32,                 \
+        int:                sb_i32,                 \
+        long:               sb_i32,                 \
+        unsigned char:      sb_u32,                 \
+        unsigned short:     sb_u32,                 \
+        unsigned int:       sb_u32,                 \
+        unsigned long:      sb_u32,                 \
+        hex_t:              sb_hex)(sb, x)
+
+/* SB_CAT(&sb, "Raw=", val, "\r\n") appends 1..8 arguments in order.
+   Note 'x' is an int in C and prints as a number; use "x". */
+#define SB_CAT(sb, ...)                                             \
+    do { SB_N(__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1)(sb, __VA_ARGS__); } while (0)
+#define SB_N(a, b, c, d, e, f, g, h, n, ...)  SB_CAT_##n
+#define SB_CAT_1(sb, a)       SB_PUT(sb, a)
+#define SB_CAT_2(sb, a, ...)  SB_PUT(sb, a); SB_CAT_1(sb, __VA_ARGS__)
+#define SB_CAT_3(sb, a, ...)  SB_PUT(sb, a); SB_CAT_2(sb, __VA_ARGS__)
+#define SB_CAT_4(sb, a, ...)  SB_PUT(sb, a); SB_CAT_3(sb, __VA_ARGS__)
+#define SB_CAT_5(sb, a, ...)  SB_PUT(sb, a); SB_CAT_4(sb, __VA_ARGS__)
+#define SB_CAT_6(sb, a, ...)  SB_PUT(sb, a); SB_CAT_5(sb, __VA_ARGS__)
+#define SB_CAT_7(sb, a, ...)  SB_PUT(sb, a); SB_CAT_6(sb, __VA_ARGS__)
+#define SB_CAT_8(sb, a, ...)  SB_PUT(sb, a); SB_CAT_7(sb, __VA_ARGS__)
+
 /* =========================================================
    UART (bare-metal)
    ========================================================= */
@@ -79,7 +268,7 @@ void UART_Init(void)
     GPIOA_CRL |=  (0xB << 8);
     GPIOA_CRL |=  (0x4 << 12);
 
-    USART2_BRR = 0x0EA6; // 9600 baud
+    USART2_BRR = USART_BRR(PCLK1_HZ, DEBUG_BAUD);
     USART2_CR1 = (1 << 13) | (1 << 3) | (1 << 2);
 }
 
@@ -102,7 +291,8 @@ void ADC_Init(void)
 
     GPIOA_CRL &= ~(0xF << 16);   // PA4 analog
 
-    RCC_CFGR |= (2 << 14);       // ADC clk /6
+    RCC_CFGR &= ~(3 << 14);
+    RCC_CFGR |= (ADCPRE_BITS << 14);   // ADC clk <= 14 MHz
     ADC1_SMPR2 |= (7 << 12);     // long sample
     ADC1_SQR3 = 4;
 
@@ -127,7 +317,7 @@ void SPI_Init(void)
 
     GPIOA_CRL |= (0xB << 20) | (0x4 << 24) | (0xB << 28);
 
-    SPI1_CR1 = (1 << 2) | (1 << 9) | (1 << 8) | (3 << 3);
+    SPI1_CR1 = (1 << 2) | (1 << 9) | (1 << 8) | (SPI_BR_BITS << 3);
     SPI1_CR1 |= (1 << 6);
 }
 
@@ -161,8 +351,12 @@ void ADC_Task(void *p)
         adc_val = ADC1_DR;
 
         int percent = (adc_val * 100) / 4095;
-        sprintf(uartBuf, "[ADC ] Raw=%d  %%=%d\r\n", adc_val, percent);
-        xSemaphoreGive(uartSem);
+        uart_msg_t msg;
+        strbuf_t sb;
+
+        sb_init(&sb, msg.text, sizeof(msg.text));
+        SB_CAT(&sb, "[ADC ] Raw=", adc_val, "  %=", percent, "\r\n");
+        xQueueSend(uartQueue, &msg, portMAX_DELAY);
 
         vTaskDelay(pdMS_TO_TICKS(1000));
     }
@@ -173,8 +367,12 @@ void SPI_Task(void *p)
     while (1)
     {
         uint8_t r = SPI_Transfer(0x55);
-        sprintf(uartBuf, "[SPI ] RX=0x%02X\r\n", r);
-        xSemaphoreGive(uartSem);
+        uart_msg_t msg;
+        strbuf_t sb;
+
+        sb_init(&sb, msg.text, sizeof(msg.text));
+        SB_CAT(&sb, "[SPI ] RX=0x", HEX(r, 2), "\r\n");
+        xQueueSend(uartQueue, &msg, portMAX_DELAY);
 
         vTaskDelay(pdMS_TO_TICKS(2000));
     }
@@ -184,8 +382,12 @@ void I2C_Task(void *p)
 {
     while (1)
     {
-        sprintf(uartBuf, "[I2C ] Bus Active\r\n");
-        xSemaphoreGive(uartSem);
+        uart_msg_t msg;
+        strbuf_t sb;
+
+        sb_init(&sb, msg.text, sizeof(msg.text));
+        sb_str(&sb, "[I2C ] Bus Active\r\n");
+        xQueueSend(uartQueue, &msg, portMAX_DELAY);
 
         vTaskDelay(pdMS_TO_TICKS(3000));
     }
@@ -195,8 +397,10 @@ void UART_Task(void *p)
 {
     while (1)
     {
-        xSemaphoreTake(uartSem, portMAX_DELAY);
-        UART_SendString(uartBuf);
+        uart_msg_t msg;
+
+        xQueueReceive(uartQueue, &msg, portMAX_DELAY);
+        UART_SendString(msg.text);
     }
 }
 
@@ -211,7 +415,7 @@ int main(void)
     SPI_Init();
     I2C_Init();
 
-    uartSem = xSemaphoreCreateBinary();
+    uartQueue = xQueueCreate(UART_QUEUE_LEN, sizeof(uart_msg_t));
 
     xTaskCreate(LED_Task,  "LED",  128, NULL, 1, NULL);
     xTaskCreate(ADC_Task,  "ADC",  256, NULL, 2, NULL);
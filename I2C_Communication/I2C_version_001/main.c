@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <stdarg.h>
 
 /* ================= RCC ================= */
 #define RCC_APB2ENR   (*(volatile uint32_t*)0x40021018)
@@ -26,6 +27,60 @@
 #define I2C1_CCR      (*(volatile uint32_t*)0x4000541C)
 #define I2C1_TRISE    (*(volatile uint32_t*)0x40005420)
 
+/* ================= CLOCK TREE ================= */
+/* Same selection as SetSysClockTo72() in system_stm32f10x.c:
+   HSE 8 MHz x PLL 9 = SYSCLK 72 MHz, AHB /1, APB1 /2, APB2 /1 */
+#define HSE_HZ        8000000UL
+#define SYSCLK_HZ     (HSE_HZ * 9)
+#define HCLK_HZ       (SYSCLK_HZ / 1)
+#define PCLK1_HZ      (HCLK_HZ / 2)       // APB1: USART2/3, I2C1
+#define PCLK2_HZ      (HCLK_HZ / 1)       // APB2: USART1, SPI1, ADC1
+
+/* USART, 16x oversampling: BRR = PCLK / baud, error in 0.1 % steps */
+#define USART_BRR(pclk, baud)   (((pclk) + (baud) / 2) / (baud))
+#define USART_REAL(pclk, baud)  ((pclk) / USART_BRR(pclk, baud))
+#define USART_ERR(pclk, baud)                                   \
+    ((USART_REAL(pclk, baud) > (baud) ?                         \
+      USART_REAL(pclk, baud) - (baud) :                         \
+      (baud) - USART_REAL(pclk, baud)) * 1000 / (baud))
+#define USART_CHECK(pclk, baud, name)                           \
+    _Static_assert(USART_BRR(pclk, baud) >= 16 &&               \
+                   USART_ERR(pclk, baud) <= 20,                 \
+                   name " baud rate out of tolerance")
+
+/* I2C1 standard mode: CR2 FREQ in MHz, CCR for Thigh = Tlow,
+   TRISE for 1000 ns max rise time */
+#define I2C_HZ        100000UL
+#define I2C_FREQ      (PCLK1_HZ / 1000000)
+#define I2C_CCR_VAL   (PCLK1_HZ / (2 * I2C_HZ))
+#define I2C_TRISE_VAL (I2C_FREQ + 1)
+_Static_assert(I2C_FREQ >= 2 && I2C_FREQ <= 36, "I2C1 PCLK1 out of range");
+_Static_assert(I2C_CCR_VAL >= 4, "I2C1 CCR below standard-mode minimum");
+_Static_assert(PCLK1_HZ / (2 * I2C_CCR_VAL) <= I2C_HZ, "I2C1 SCL too fast");
+
+#define DEBUG_BAUD    9600
+USART_CHECK(PCLK1_HZ, DEBUG_BAUD, "USART2");
+
+/* ================= DEFERRED LOG ================= */
+/* LOG("fmt", args...) sends a string ID and raw args, never the text:
+     0xA0 | nargs    1 byte (nargs 0..4)
+     id              2 bytes LE, offset of the string in LOGSTR
+     args            4 bytes LE each
+   Format strings are local objects s_ in section .logstr. main.sct
+   gives it its own load region LOGSTR outside flash, so the text is
+   only in Objects/main.axf, where log_decode.py reads it back. The
+   strings are never read on the target. LOGSTR is capped at 64 KB,
+   so armlink fails (L6220E) before an offset can outgrow 16 bits. */
+#define LOG_STR(fmt)                                                \
+    ({ static const char s_[]                                       \
+           __attribute__((section(".logstr"), used)) = fmt; s_; })
+#define LOG_NARGS(...)              LOG_NARGS_(0, ##__VA_ARGS__, 4, 3, 2, 1, 0)
+#define LOG_NARGS_(z, a, b, c, d, n, ...)  n
+#define LOG(fmt, ...)                                               \
+    log_emit(LOG_STR(fmt), LOG_NARGS(__VA_ARGS__), ##__VA_ARGS__)
+
+extern const char Image$$LOGSTR$$Base[];    // armlink, from main.sct
+
 /* ================= UART FUNCTIONS ================= */
 void uart2_send_char(char c)
 {
@@ -39,11 +94,26 @@ void uart2_send_string(const char *s)
         uart2_send_char(*s++);
 }
 
-void uart2_send_hex(uint8_t v)
+/* ================= DEFERRED LOG ================= */
+void log_emit(const char *fmt, int nargs, ...)
 {
-    const char map[] = "0123456789ABCDEF";
-    uart2_send_char(map[(v >> 4) & 0x0F]);
-    uart2_send_char(map[v & 0x0F]);
+    uint32_t id = fmt - Image$$LOGSTR$$Base;
+    va_list ap;
+
+    uart2_send_char(0xA0 | nargs);
+    uart2_send_char(id);
+    uart2_send_char(id >> 8);
+
+    va_start(ap, nargs);
+    while (nargs--)
+    {
+        uint32_t v = va_arg(ap, uint32_t);
+        uart2_send_char(v);
+        uart2_send_char(v >> 8);
+        uart2_send_char(v >> 16);
+        uart2_send_char(v >> 24);
+    }
+    va_end(ap);
 }
 
 /* ================= I2C INIT ================= */
@@ -66,12 +136,12 @@ void i2c1_init(void)
     I2C1_CR1 |=  (1 << 15);
     I2C1_CR1 &= ~(1 << 15);
 
-    /* PCLK1 = 36 MHz */
-    I2C1_CR2 = 36;
+    /* PCLK1 in MHz */
+    I2C1_CR2 = I2C_FREQ;
 
-    /* Standard mode 100 kHz */
-    I2C1_CCR = 180;
-    I2C1_TRISE = 37;
+    /* Standard mode I2C_HZ */
+    I2C1_CCR = I2C_CCR_VAL;
+    I2C1_TRISE = I2C_TRISE_VAL;
 
     /* Enable I2C */
     I2C1_CR1 |= (1 << 0);
@@ -123,21 +193,21 @@ int main(void)
     GPIOA_CRL |=  (0xB << 8);  // TX
     GPIOA_CRL |=  (0x4 << 12); // RX
 
-    /* UART2 baud = 9600 */
-    USART2_BRR = 0x0EA6;
+    /* UART2 baud = DEBUG_BAUD */
+    USART2_BRR = USART_BRR(PCLK1_HZ, DEBUG_BAUD);
     USART2_CR1 = (1 << 13) | (1 << 3) | (1 << 2);
 
     /* Init I2C */
     i2c1_init();
 
     /* Print header */
-    uart2_send_string("\r\nWelcome to I2C Communication:\r\n");
-    uart2_send_string("Theme of Project is Interfacing I2C\r\n\r\n");
-    uart2_send_string("Heading: I2C Scanner\r\n");
-    uart2_send_string("Master : STM32F103C8T6\r\n");
-    uart2_send_string("Slave  : OLED Display (I2C)\r\n");
-    uart2_send_string("Pins   : PB8 (SCL), PB9 (SDA)\r\n\r\n");
-    uart2_send_string("I2C Scanner Started...\r\n\r\n");
+    LOG("\r\nWelcome to I2C Communication:\r\n");
+    LOG("Theme of Project is Interfacing I2C\r\n\r\n");
+    LOG("Heading: I2C Scanner\r\n");
+    LOG("Master : STM32F103C8T6\r\n");
+    LOG("Slave  : OLED Display (I2C)\r\n");
+    LOG("Pins   : PB8 (SCL), PB9 (SDA)\r\n\r\n");
+    LOG("I2C Scanner Started...\r\n\r\n");
 
     /* Scan addresses */
     for (uint8_t addr = 0x08; addr < 0x78; addr++)
@@ -145,13 +215,11 @@ int main(void)
         i2c_start();
         if (i2c_check_address(addr))
         {
-            uart2_send_string("Address Found: 0x");
-            uart2_send_hex(addr);
-            uart2_send_string("\r\n");
+            LOG("Address Found: 0x%02X\r\n", addr);
         }
     }
 
-    uart2_send_string("\r\nScan Complete\r\n");
+    LOG("\r\nScan Complete\r\n");
 
     while (1);
 }
@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include "ring.h"
 
 /* ================================================================
    STM32F103 – ADC INTERRUPT BASED POTENTIOMETER READING
@@ -6,16 +7,24 @@
    • ADC1 reads potentiometer on PA4
    • ADC conversion complete generates interrupt
    • ISR stores ADC value
-   • Main loop maps ADC value (0–4095) → (0–100)
-   • UART2 prints raw & mapped values
+   • Main loop takes one sample every SAMPLE_PERIOD_MS (SysTick)
+   • UART2 sends binary frames: COBS + CRC16, 12-bit packed samples
+     (decode on the PC with telemetry_decode.py)
+   • UART2 TX is queued in RAM and drained by DMA1 Channel 7
+   • USART1 streams every raw sample at high baud (DMA1 Channel 4)
    ================================================================*/
 
 
+/* uart_dma_sim.c builds this file on a PC: it defines HOST_SIM and
+   maps every register below onto a simulated USART2 / DMA1 */
+#ifndef HOST_SIM
+
 /* ================================================================
    RCC (RESET AND CLOCK CONTROL) REGISTERS
    ------------------------------------------------
-   Used to enable clocks for GPIO, ADC, USART
+   Used to enable clocks for GPIO, ADC, USART, DMA
    ================================================================*/
+#define RCC_AHBENR      (*(volatile uint32_t*)0x40021014)
 #define RCC_APB2ENR     (*(volatile uint32_t*)0x40021018)
 #define RCC_APB1ENR     (*(volatile uint32_t*)0x4002101C)
 #define RCC_CFGR        (*(volatile uint32_t*)0x40021004)
@@ -27,8 +36,10 @@
    • PA2 → USART2_TX
    • PA3 → USART2_RX
    • PA4 → ADC input (analog)
+   • PA9 → USART1_TX (telemetry)
    ================================================================*/
 #define GPIOA_CRL       (*(volatile uint32_t*)0x40010800)
+#define GPIOA_CRH       (*(volatile uint32_t*)0x40010804)
 
 
 /* ================================================================
@@ -38,6 +49,35 @@
 #define USART2_DR       (*(volatile uint32_t*)0x40004404)
 #define USART2_BRR      (*(volatile uint32_t*)0x40004408)
 #define USART2_CR1      (*(volatile uint32_t*)0x4000440C)
+#define USART2_CR3      (*(volatile uint32_t*)0x40004414)
+
+
+/* ================================================================
+   USART1 REGISTERS (TELEMETRY, APB2 = 72 MHz)
+   ================================================================*/
+#define USART1_SR       (*(volatile uint32_t*)0x40013800)
+#define USART1_DR       (*(volatile uint32_t*)0x40013804)
+#define USART1_BRR      (*(volatile uint32_t*)0x40013808)
+#define USART1_CR1      (*(volatile uint32_t*)0x4001380C)
+#define USART1_CR3      (*(volatile uint32_t*)0x40013814)
+
+
+/* ================================================================
+   DMA1 REGISTERS
+   ------------------------------------------------
+   • Channel 4 is hard-wired to USART1_TX
+   • Channel 7 is hard-wired to USART2_TX
+   ================================================================*/
+#define DMA1_ISR        (*(volatile uint32_t*)0x40020000)
+#define DMA1_IFCR       (*(volatile uint32_t*)0x40020004)
+#define DMA1_CCR4       (*(volatile uint32_t*)0x40020044)
+#define DMA1_CNDTR4     (*(volatile uint32_t*)0x40020048)
+#define DMA1_CPAR4      (*(volatile uint32_t*)0x4002004C)
+#define DMA1_CMAR4      (*(volatile uint32_t*)0x40020050)
+#define DMA1_CCR7       (*(volatile uint32_t*)0x40020080)
+#define DMA1_CNDTR7     (*(volatile uint32_t*)0x40020084)
+#define DMA1_CPAR7      (*(volatile uint32_t*)0x40020088)
+#define DMA1_CMAR7      (*(volatile uint32_t*)0x4002008C)
 
 
 /* ================================================================
@@ -51,6 +91,16 @@
 #define ADC1_DR         (*(volatile uint32_t*)0x4001244C)
 
 
+/* ================================================================
+   SYSTICK REGISTERS
+   ------------------------------------------------
+   1 ms time base for sampling and frame timestamps
+   ================================================================*/
+#define SYST_CSR        (*(volatile uint32_t*)0xE000E010)
+#define SYST_RVR        (*(volatile uint32_t*)0xE000E014)
+#define SYST_CVR        (*(volatile uint32_t*)0xE000E018)
+
+
 /* ================================================================
    NVIC REGISTERS
    ------------------------------------------------
@@ -59,12 +109,105 @@
 #define NVIC_ISER0      (*(volatile uint32_t*)0xE000E100)
 
 
+/* ================================================================
+   GLOBAL INTERRUPT MASK (PRIMASK)
+   ================================================================*/
+#define IRQ_DISABLE()   __asm volatile ("cpsid i" ::: "memory")
+#define IRQ_ENABLE()    __asm volatile ("cpsie i" ::: "memory")
+
+#endif /* HOST_SIM */
+
+
+/* ================================================================
+   CLOCK TREE (COMPILE TIME)
+   ================================================================*/
+/* Same selection as SetSysClockTo72() in system_stm32f10x.c:
+   HSE 8 MHz x PLL 9 = SYSCLK 72 MHz, AHB /1, APB1 /2, APB2 /1 */
+#define HSE_HZ        8000000UL
+#define SYSCLK_HZ     (HSE_HZ * 9)
+#define HCLK_HZ       (SYSCLK_HZ / 1)
+#define PCLK1_HZ      (HCLK_HZ / 2)       // APB1: USART2/3, I2C1
+#define PCLK2_HZ      (HCLK_HZ / 1)       // APB2: USART1, SPI1, ADC1
+
+/* USART, 16x oversampling: BRR = PCLK / baud, error in 0.1 % steps */
+#define USART_BRR(pclk, baud)   (((pclk) + (baud) / 2) / (baud))
+#define USART_REAL(pclk, baud)  ((pclk) / USART_BRR(pclk, baud))
+#define USART_ERR(pclk, baud)                                   \
+    ((USART_REAL(pclk, baud) > (baud) ?                         \
+      USART_REAL(pclk, baud) - (baud) :                         \
+      (baud) - USART_REAL(pclk, baud)) * 1000 / (baud))
+#define USART_CHECK(pclk, baud, name)                           \
+    _Static_assert(USART_BRR(pclk, baud) >= 16 &&               \
+                   USART_ERR(pclk, baud) <= 20,                 \
+                   name " baud rate out of tolerance")
+
+/* ADC: smallest ADCPRE (/2 /4 /6 /8) keeping ADCCLK <= 14 MHz */
+#define ADC_MAX_HZ    14000000UL
+#define ADCPRE_BITS   (PCLK2_HZ / 2 <= ADC_MAX_HZ ? 0 :         \
+                       PCLK2_HZ / 4 <= ADC_MAX_HZ ? 1 :         \
+                       PCLK2_HZ / 6 <= ADC_MAX_HZ ? 2 : 3)
+#define ADCCLK_HZ     (PCLK2_HZ / (2 * (ADCPRE_BITS + 1)))
+_Static_assert(ADCCLK_HZ <= ADC_MAX_HZ, "ADCCLK above 14 MHz");
+
+#define DEBUG_BAUD    9600
+/* USART1 telemetry: 4500000 / 2250000 / 1125000 / 921600 ...
+   One sample = 2 bytes, ADC runs at ~47.6 kS/s → needs > 1 Mbaud */
+#define TELEM_BAUD    2250000
+USART_CHECK(PCLK1_HZ, DEBUG_BAUD, "USART2");
+USART_CHECK(PCLK2_HZ, TELEM_BAUD, "USART1");
+
+
+/* ================================================================
+   DEFINES
+   ================================================================*/
+#define TX_BUF_SIZE     256                 // Must be a power of two
+
+/* Samples per DMA block, each block starts with TELEM_SYNC.
+   Samples are 12-bit, so the sync word never appears as data. */
+#define TELEM_BLOCK     64
+#define TELEM_SYNC      0xA55A
+
+/* USART2 binary frames
+   8 samples = 26 bytes on the wire (~3 B/sample vs ~50 B as text).
+   250 S/s x 26 / 8 = 812 B/s fits the 960 B/s of 9600 baud. */
+#define SAMPLE_PERIOD_MS 4
+#define FRAME_SAMPLES   8                   // Must be even
+#define FRAME_CH_MASK   (1 << 4)            // ADC1 channel 4 (PA4)
+#define FRAME_HDR_LEN   10
+#define FRAME_RAW_LEN   (FRAME_HDR_LEN + FRAME_SAMPLES * 3 / 2 + 2)
+#define FRAME_RAW_MAX   FRAME_RAW_LEN
+
+
 /* ================================================================
    GLOBAL VARIABLES
    ================================================================*/
 volatile uint16_t adc_val = 0;      // Updated inside ADC ISR
-volatile uint16_t mapped_val = 0;   // Processed in main loop
-char msg[20];                       // UART message buffer
+volatile uint32_t ms_ticks = 0;     // Updated inside SysTick ISR
+
+/* Frame being filled by the main loop */
+uint8_t  frame[FRAME_RAW_LEN];
+uint8_t  frame_n = 0;
+uint16_t frame_seq = 0;
+
+/* UART2 TX queue
+   • tx_head : free-running write count (main loop only)
+   • tx_tail : free-running read count  (DMA ISR only)
+   • tx_dma_len : bytes owned by DMA, 0 = channel idle */
+volatile uint8_t  tx_buf[TX_BUF_SIZE];
+volatile uint16_t tx_head = 0;
+volatile uint16_t tx_tail = 0;
+volatile uint16_t tx_dma_len = 0;
+RING_CHECK(uint16_t, TX_BUF_SIZE, "UART2 TX");
+
+/* USART1 telemetry ping-pong blocks
+   • ADC ISR fills telem_blk[telem_fill]
+   • DMA sends the other block
+   • telem_drops counts blocks lost because DMA was still busy */
+uint16_t          telem_blk[2][TELEM_BLOCK + 1];
+uint8_t           telem_fill = 0;
+uint8_t           telem_idx  = 1;
+volatile uint8_t  telem_busy = 0;
+volatile uint32_t telem_drops = 0;
 
 
 /* ================================================================
@@ -79,18 +222,25 @@ void delay(int t)
 
 
 /* ================================================================
-   MAP ADC VALUE (0–4095) → PERCENTAGE (0–100)
+   SYSTICK – 1 ms TICK
    ================================================================*/
-uint16_t map_adc_to_percent(uint16_t adc)
+void SysTick_Init(void)
 {
-    return (adc * 100) / 4095;
+    SYST_RVR = HCLK_HZ / 1000 - 1;
+    SYST_CVR = 0;
+    SYST_CSR = (1 << 2) | (1 << 1) | (1 << 0);  // HCLK, TICKINT, ENABLE
+}
+
+void SysTick_Handler(void)
+{
+    ms_ticks++;
 }
 
 
 /* ================================================================
    UART2 INITIALIZATION
    ------------------------------------------------
-   • Baud rate : 9600
+   • Baud rate : DEBUG_BAUD (9600)
    • PA2 → TX, PA3 → RX
    ================================================================*/
 void UART2_Init(void)
@@ -107,71 +257,300 @@ void UART2_Init(void)
     GPIOA_CRL &= ~(0xF << 12);
     GPIOA_CRL |=  (0x4 << 12);
 
-    /* Baud rate = 9600 (PCLK1 = 36 MHz) */
-    USART2_BRR = 0xEA6;
+    /* Baud rate = DEBUG_BAUD (PCLK1 = 36 MHz) */
+    USART2_BRR = USART_BRR(PCLK1_HZ, DEBUG_BAUD);
 
     /* Enable USART, TX, RX */
     USART2_CR1 |= (1 << 13) | (1 << 3) | (1 << 2);
+
+    /* ---------------- DMA1 Channel 7 → USART2_DR ---------------- */
+    RCC_AHBENR |= (1 << 0);       // DMA1
+
+    /* USART2 requests DMA on TXE */
+    USART2_CR3 |= (1 << 7);       // DMAT
+
+    DMA1_CCR7  = 0;
+    DMA1_CPAR7 = (uint32_t)&USART2_DR;
+
+    /* MINC, memory → peripheral, TC interrupt, 8-bit both sides */
+    DMA1_CCR7  = (1 << 7) | (1 << 4) | (1 << 1);
+
+    /* Enable DMA1 Channel 7 interrupt in NVIC (IRQ17) */
+    NVIC_ISER0 |= (1 << 17);
+}
+
+
+/* ================================================================
+   UART2 TX DMA
+   ------------------------------------------------
+   Starts DMA on the next contiguous run of queued bytes.
+   Called from main (with IRQs masked) and from the DMA ISR.
+   ================================================================*/
+void UART2_DMA_Start(void)
+{
+    uint16_t count, start, len;
+
+    if (tx_dma_len)                     // Transfer already running
+        return;
+
+    count = RING_COUNT(uint16_t, tx_head, tx_tail);
+    if (count == 0)
+        return;
+
+    /* Stop at buffer end, the wrapped part goes in the next run */
+    start = RING_SLOT(tx_tail, TX_BUF_SIZE);
+    len   = RING_RUN(count, tx_tail, TX_BUF_SIZE);
+
+    DMA1_CCR7  &= ~(1 << 0);            // EN = 0 before reprogramming
+    DMA1_CMAR7  = (uint32_t)&tx_buf[start];
+    DMA1_CNDTR7 = len;
+    tx_dma_len  = len;
+    DMA1_CCR7  |=  (1 << 0);            // EN = 1
 }
 
 
 /* ================================================================
    UART TRANSMIT FUNCTIONS
+   ------------------------------------------------
+   Bytes are copied into tx_buf and the call returns at once.
+   Only blocks if the queue is full.
    ================================================================*/
+void UART2_Kick(void)
+{
+    IRQ_DISABLE();
+    UART2_DMA_Start();
+    IRQ_ENABLE();
+}
+
+void UART2_Put(char c)
+{
+    while (RING_FULL(uint16_t, tx_head, tx_tail, TX_BUF_SIZE))
+        UART2_Kick();                   // Queue full, wait for DMA
+
+    tx_buf[RING_SLOT(tx_head, TX_BUF_SIZE)] = c;
+    tx_head++;
+}
+
 void UART2_SendChar(char c)
 {
-    while (!(USART2_SR & (1 << 7)));   // Wait until TX buffer empty
-    USART2_DR = c;
+    UART2_Put(c);
+    UART2_Kick();
 }
 
 void UART2_SendString(char *s)
 {
     while (*s)
-        UART2_SendChar(*s++);
+        UART2_Put(*s++);
+
+    UART2_Kick();                       // One DMA start per string
 }
 
 
 /* ================================================================
-   INTEGER TO STRING CONVERSION
+   DMA1 CHANNEL 7 INTERRUPT (USART2 TX COMPLETE)
+   ------------------------------------------------
+   Releases the finished run and chains the next one.
    ================================================================*/
-void int_to_str(uint16_t val, char *buf)
+void DMA1_Channel7_IRQHandler(void)
 {
-    int i = 0, j = 0;
-    char temp[6];
+    if (DMA1_ISR & (1 << 25))           // TCIF7
+    {
+        DMA1_IFCR = (1 << 24);          // CGIF7 clears all ch7 flags
 
-    if (val == 0)
-        buf[i++] = '0';
-    else
+        tx_tail   += tx_dma_len;
+        tx_dma_len = 0;
+
+        UART2_DMA_Start();
+    }
+}
+
+
+/* ================================================================
+   USART1 TELEMETRY INITIALIZATION
+   ------------------------------------------------
+   • Baud rate : TELEM_BAUD (TX only)
+   • PA9 → TX
+   • DMA1 Channel 4 sends whole sample blocks
+   ================================================================*/
+void TELEM_Init(void)
+{
+    /* Enable clocks */
+    RCC_APB2ENR |= (1 << 2);      // GPIOA
+    RCC_APB2ENR |= (1 << 14);     // USART1
+    RCC_AHBENR  |= (1 << 0);      // DMA1
+
+    /* PA9 → TX (AF Push-Pull, 50 MHz) */
+    GPIOA_CRH &= ~(0xF << 4);
+    GPIOA_CRH |=  (0xB << 4);
+
+    USART1_BRR = USART_BRR(PCLK2_HZ, TELEM_BAUD);
+
+    /* USART1 requests DMA on TXE */
+    USART1_CR3 |= (1 << 7);       // DMAT
+
+    /* Enable USART, TX */
+    USART1_CR1 |= (1 << 13) | (1 << 3);
+
+    /* MINC, memory → peripheral, TC interrupt, 8-bit both sides */
+    DMA1_CCR4  = 0;
+    DMA1_CPAR4 = (uint32_t)&USART1_DR;
+    DMA1_CCR4  = (1 << 7) | (1 << 4) | (1 << 1);
+
+    /* Enable DMA1 Channel 4 interrupt in NVIC (IRQ14) */
+    NVIC_ISER0 |= (1 << 14);
+
+    telem_blk[0][0] = TELEM_SYNC;
+    telem_blk[1][0] = TELEM_SYNC;
+}
+
+
+/* ================================================================
+   TELEMETRY SAMPLE PUSH (called from ADC ISR)
+   ------------------------------------------------
+   When a block is full it is handed to DMA and filling
+   continues in the other block.
+   ================================================================*/
+void TELEM_Put(uint16_t sample)
+{
+    telem_blk[telem_fill][telem_idx++] = sample;
+
+    if (telem_idx <= TELEM_BLOCK)
+        return;
+
+    telem_idx = 1;
+
+    if (telem_busy)
+    {
+        telem_drops++;                  // Link too slow, reuse block
+        return;
+    }
+
+    telem_busy  = 1;
+    DMA1_CCR4  &= ~(1 << 0);
+    DMA1_CMAR4  = (uint32_t)telem_blk[telem_fill];
+    DMA1_CNDTR4 = sizeof(telem_blk[0]);
+    DMA1_CCR4  |=  (1 << 0);
+
+    telem_fill ^= 1;
+}
+
+
+/* ================================================================
+   DMA1 CHANNEL 4 INTERRUPT (USART1 TX COMPLETE)
+   ================================================================*/
+void DMA1_Channel4_IRQHandler(void)
+{
+    if (DMA1_ISR & (1 << 13))           // TCIF4
+    {
+        DMA1_IFCR = (1 << 12);          // CGIF4 clears all ch4 flags
+        telem_busy = 0;
+    }
+}
+
+
+/* ================================================================
+   CRC-16/CCITT (poly 0x1021, init 0xFFFF)
+   ================================================================*/
+uint16_t crc16(const uint8_t *p, uint16_t len)
+{
+    uint16_t crc = 0xFFFF;
+
+    while (len--)
+    {
+        crc ^= (uint16_t)(*p++) << 8;
+        for (int i = 0; i < 8; i++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+    }
+    return crc;
+}
+
+
+/* ================================================================
+   COBS ENCODE + SEND
+   ------------------------------------------------
+   Removes every 0x00 from the frame so 0x00 can mark
+   the frame end. Overhead: 1 byte per 254 + delimiter.
+   ================================================================*/
+void UART2_SendCOBS(const uint8_t *p, uint16_t len)
+{
+    uint8_t  out[FRAME_RAW_MAX + FRAME_RAW_MAX / 254 + 2];
+    uint16_t code_at = 0, o = 1;
+    uint8_t  code = 1;
+
+    for (uint16_t i = 0; i < len; i++)
     {
-        while (val)
+        if (p[i] != 0)
         {
-            temp[j++] = (val % 10) + '0';
-            val /= 10;
+            out[o++] = p[i];
+            code++;
+        }
+
+        if (p[i] == 0 || code == 0xFF)
+        {
+            out[code_at] = code;
+            code_at = o++;
+            code = 1;
         }
-        while (j)
-            buf[i++] = temp[--j];
     }
+    out[code_at] = code;
+    out[o++] = 0x00;                    // Frame delimiter
 
-    buf[i++] = '\r';
-    buf[i++] = '\n';
-    buf[i] = '\0';
+    for (uint16_t i = 0; i < o; i++)
+        UART2_Put(out[i]);
+    UART2_Kick();
 }
 
 
 /* ================================================================
-   PRINT ADC VALUES OVER UART
+   TELEMETRY FRAME
+   ------------------------------------------------
+   Raw frame (little-endian), then COBS + 0x00 on the wire:
+   | seq u16 | t_ms u32 | ch_mask u16 | period_ms u8 | n u8 |
+   | n x 12-bit samples, 2 per 3 bytes | crc16 u16 |
+   t_ms is the time of the first sample.
    ================================================================*/
-void print_adc_values(uint16_t raw, uint16_t mapped)
+void FRAME_Add(uint16_t sample, uint32_t t_ms)
 {
-    UART2_SendString("Raw value   : ");
-    int_to_str(raw, msg);
-    UART2_SendString(msg);
+    uint8_t *d = &frame[FRAME_HDR_LEN + (frame_n / 2) * 3];
 
-    UART2_SendString("Mapped value: ");
-    int_to_str(mapped, msg);
-    UART2_SendString(msg);
+    if (frame_n == 0)
+    {
+        frame[2] = t_ms;
+        frame[3] = t_ms >> 8;
+        frame[4] = t_ms >> 16;
+        frame[5] = t_ms >> 24;
+    }
 
-    UART2_SendString("--------------------\r\n");
+    /* Pack two 12-bit samples into three bytes */
+    if ((frame_n & 1) == 0)
+    {
+        d[0] = sample;
+        d[1] = (sample >> 8) & 0x0F;
+    }
+    else
+    {
+        d[1] |= (sample & 0x0F) << 4;
+        d[2] = sample >> 4;
+    }
+
+    if (++frame_n < FRAME_SAMPLES)
+        return;
+
+    frame[0] = frame_seq;
+    frame[1] = frame_seq >> 8;
+    frame[6] = FRAME_CH_MASK;
+    frame[7] = FRAME_CH_MASK >> 8;
+    frame[8] = SAMPLE_PERIOD_MS;
+    frame[9] = FRAME_SAMPLES;
+
+    uint16_t crc = crc16(frame, FRAME_RAW_LEN - 2);
+    frame[FRAME_RAW_LEN - 2] = crc;
+    frame[FRAME_RAW_LEN - 1] = crc >> 8;
+
+    UART2_SendCOBS(frame, FRAME_RAW_LEN);
+
+    frame_seq++;
+    frame_n = 0;
 }
 
 
@@ -188,9 +567,9 @@ void ADC_Init(void)
     RCC_APB2ENR |= (1 << 2);   // GPIOA
     RCC_APB2ENR |= (1 << 9);   // ADC1
 
-    /* ADC clock = PCLK2 / 6 = 12 MHz */
+    /* ADC clock = ADCCLK_HZ (PCLK2 / 6 = 12 MHz) */
     RCC_CFGR &= ~(3 << 14);
-    RCC_CFGR |=  (2 << 14);
+    RCC_CFGR |=  (ADCPRE_BITS << 14);
 
     /* PA4 as analog input */
     GPIOA_CRL &= ~(0xF << 16);
@@ -242,6 +621,8 @@ void ADC1_2_IRQHandler(void)
     {
         adc_val = ADC1_DR;   // Read ADC result (clears EOC)
         ADC1_SR &= ~(1 << 1);
+
+        TELEM_Put(adc_val);  // Every sample goes out on USART1
     }
 }
 
@@ -251,19 +632,26 @@ void ADC1_2_IRQHandler(void)
    ================================================================*/
 int main(void)
 {
+    uint32_t next;
+
     UART2_Init();    // Initialize UART
+    TELEM_Init();    // Initialize USART1 telemetry
     ADC_Init();      // Initialize ADC + interrupt
+    SysTick_Init();  // 1 ms time base
+
+    /* Text banner, then 0x00 so the decoder syncs on the first frame */
+    UART2_SendString("ADC Pot Value (Interrupt Mode, binary frames):\r\n");
+    UART2_SendChar(0x00);
 
-    UART2_SendString("ADC Pot Value (Interrupt Mode):\r\n");
+    next = ms_ticks;
 
     while (1)
     {
-        /* Process ADC data (outside ISR) */
-        mapped_val = map_adc_to_percent(adc_val);
-
-        /* Print values */
-        print_adc_values(adc_val, mapped_val);
-
-        delay(500);
+        /* One sample every SAMPLE_PERIOD_MS, framed and queued */
+        if ((int32_t)(ms_ticks - next) >= 0)
+        {
+            FRAME_Add(adc_val, next);
+            next += SAMPLE_PERIOD_MS;
+        }
     }
 }
@@ -0,0 +1,32 @@
+#ifndef RING_H
+#define RING_H
+
+/* ================================================================
+   FREE-RUNNING RING INDICES
+   ------------------------------------------------
+   head counts entries written, tail counts entries read. Both only
+   ever increment and wrap at the width of their type T, so
+   (T)(head - tail) is the fill level across the wrap too, and a
+   full ring never looks empty. The slot is index & (size - 1).
+   uart_dma_sim.c runs them, through main.c, on the host.
+   ================================================================*/
+
+/* size must be a power of two below the range of T: a count of
+   exactly 2^bits would read as 0, so uint8_t indices allow 128 */
+#define RING_CHECK(T, size, name)                               \
+    _Static_assert(((size) & ((size) - 1)) == 0 &&              \
+                   (size) <= (T)~(T)0,                          \
+                   name " ring size not a power of two < index range")
+
+#define RING_COUNT(T, head, tail)       ((T)((head) - (tail)))
+#define RING_EMPTY(head, tail)          ((head) == (tail))
+#define RING_FULL(T, head, tail, size)  (RING_COUNT(T, head, tail) >= (size))
+#define RING_SLOT(i, size)              ((i) & ((size) - 1))
+
+/* Of 'count' queued entries, how many lie in one piece from tail
+   to the buffer end (one DMA run; the rest starts at slot 0) */
+#define RING_RUN(count, tail, size)                             \
+    ((count) < (size) - RING_SLOT(tail, size) ?                 \
+     (count) : (size) - RING_SLOT(tail, size))
+
+#endif
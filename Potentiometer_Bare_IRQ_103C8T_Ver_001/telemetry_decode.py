@@ -0,0 +1,109 @@
+import struct
+import sys
+
+# Decodes the USART2 binary frames sent by main.c (and by the Poll
+# project, Potentiometer_Bare_Poll_103C8T_Ver_001) and prints CSV.
+#
+#   python3 telemetry_decode.py /dev/ttyUSB0 [baud]   (needs pyserial)
+#   python3 telemetry_decode.py capture.bin
+#   cat capture.bin | python3 telemetry_decode.py
+#
+# Wire format: COBS(raw frame) + 0x00
+# Raw frame  : seq u16 | t_ms u32 | ch_mask u16 | period_ms u8 | n u8 |
+#              n x 12-bit samples (2 per 3 bytes) | crc16 u16
+
+HDR = struct.Struct("<HIHBB")
+
+
+def crc16(data):
+    crc = 0xFFFF
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            return None
+        out += data[i + 1:i + code]
+        i += code
+        if code != 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def unpack12(data, n):
+    samples = []
+    for k in range(n):
+        d = data[(k // 2) * 3:(k // 2) * 3 + 3]
+        if k % 2 == 0:
+            samples.append(d[0] | ((d[1] & 0x0F) << 8))
+        else:
+            samples.append((d[1] >> 4) | (d[2] << 4))
+    return samples
+
+
+def open_input(argv):
+    if len(argv) < 2:
+        return sys.stdin.buffer
+    if argv[1].startswith("/dev/"):
+        import serial
+        baud = int(argv[2]) if len(argv) > 2 else 9600
+        return serial.Serial(argv[1], baud)
+    return open(argv[1], "rb")
+
+
+def main():
+    src = open_input(sys.argv)
+    buf = bytearray()
+    synced = False
+    last_seq = None
+    bad = 0
+
+    print("seq,time_ms,channel,raw,percent")
+
+    while True:
+        chunk = src.read(1) if hasattr(src, "in_waiting") else src.read(4096)
+        if not chunk:
+            break
+        for b in chunk:
+            if b != 0:
+                buf.append(b)
+                continue
+
+            frame = cobs_decode(bytes(buf)) if synced else None
+            buf.clear()
+            synced = True                 # everything before first 0x00 is text
+            if frame is None:
+                continue
+
+            if len(frame) < HDR.size + 2 or \
+               crc16(frame[:-2]) != struct.unpack("<H", frame[-2:])[0]:
+                bad += 1
+                print("bad frame (%d so far)" % bad, file=sys.stderr)
+                continue
+
+            seq, t_ms, mask, period, n = HDR.unpack_from(frame)
+            if last_seq is not None and seq != (last_seq + 1) & 0xFFFF:
+                print("lost %d frame(s) before seq %d"
+                      % ((seq - last_seq - 1) & 0xFFFF, seq), file=sys.stderr)
+            last_seq = seq
+
+            channels = [c for c in range(16) if mask & (1 << c)]
+            samples = unpack12(frame[HDR.size:-2], n)
+            for k, raw in enumerate(samples):
+                ch = channels[k % len(channels)]
+                t = t_ms + (k // len(channels)) * period
+                print("%d,%d,%d,%d,%d" % (seq, t, ch, raw, raw * 100 // 4095))
+            sys.stdout.flush()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,486 @@
+/* ================================================================
+   HOST HARNESS: UART2 TX QUEUE ON DMA1 CHANNEL 7
+   ------------------------------------------------
+   Not part of the Keil project. Builds main.c on a PC (HOST_SIM
+   maps its registers onto the sim struct below) and runs the real
+   UART2_Put / UART2_DMA_Start / DMA1_Channel7_IRQHandler against a
+   model of USART2 + DMA1 ch7, in simulated time:
+
+       gcc -O2 -Wall -Wno-pointer-to-int-cast uart_dma_sim.c \
+           -o uart_dma_sim && ./uart_dma_sim
+
+   Time is counted in HCLK cycles. While enabled with CNDTR7 > 0 the
+   channel puts one byte on the wire per character time (10 bits at
+   the BRR main.c programs). At CNDTR7 = 0 it sets TCIF7 and runs the
+   handler, or pends it while main has IRQs masked. TC comes when the
+   last byte has left the wire, so every run adds the handler latency
+   as a gap: the real DR double buffer hides it, the model does not.
+
+   CPU cost is a model, not a measurement (Cortex-M3 estimates):
+     CYC_PUT  per byte queued by UART2_Put
+     CYC_KICK per UART2_Kick (cpsid, UART2_DMA_Start, cpsie)
+     CYC_IRQ  per DMA1_Channel7_IRQHandler, entry and exit included
+   A queue-full wait in UART2_Put is busy until the next DMA event.
+   The rest is idle, i.e. free for sampling. "blocking TXE" is the
+   idle the old per-byte TXE loop would leave for the same bytes.
+
+   Every workload starts with tx_head / tx_tail just below the
+   uint16_t wrap and checks the wire against what was queued.
+   ================================================================*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CYC_PUT       20
+#define CYC_KICK      25
+#define CYC_IRQ       80
+
+/* ================================================================
+   SIMULATED REGISTERS
+   ================================================================*/
+struct
+{
+    volatile uint32_t RCC_AHBENR, RCC_APB2ENR, RCC_APB1ENR, RCC_CFGR;
+    volatile uint32_t GPIOA_CRL, GPIOA_CRH;
+    volatile uint32_t USART2_SR, USART2_DR, USART2_BRR, USART2_CR1, USART2_CR3;
+    volatile uint32_t USART1_SR, USART1_DR, USART1_BRR, USART1_CR1, USART1_CR3;
+    volatile uint32_t DMA1_ISR, DMA1_IFCR;
+    volatile uint32_t DMA1_CCR4, DMA1_CNDTR4, DMA1_CPAR4, DMA1_CMAR4;
+    volatile uint32_t DMA1_CCR7, DMA1_CNDTR7, DMA1_CPAR7, DMA1_CMAR7;
+    volatile uint32_t ADC1_SR, ADC1_CR1, ADC1_CR2, ADC1_SMPR2, ADC1_SQR3, ADC1_DR;
+    volatile uint32_t SYST_CSR, SYST_RVR, SYST_CVR;
+    volatile uint32_t NVIC_ISER0;
+} sim;
+
+#define RCC_AHBENR    sim.RCC_AHBENR
+#define RCC_APB2ENR   sim.RCC_APB2ENR
+#define RCC_APB1ENR   sim.RCC_APB1ENR
+#define RCC_CFGR      sim.RCC_CFGR
+#define GPIOA_CRL     sim.GPIOA_CRL
+#define GPIOA_CRH     sim.GPIOA_CRH
+#define USART2_SR     sim.USART2_SR
+#define USART2_DR     sim.USART2_DR
+#define USART2_BRR    sim.USART2_BRR
+#define USART2_CR1    sim.USART2_CR1
+#define USART2_CR3    sim.USART2_CR3
+#define USART1_SR     sim.USART1_SR
+#define USART1_DR     sim.USART1_DR
+#define USART1_BRR    sim.USART1_BRR
+#define USART1_CR1    sim.USART1_CR1
+#define USART1_CR3    sim.USART1_CR3
+#define DMA1_ISR      sim.DMA1_ISR
+#define DMA1_IFCR     sim.DMA1_IFCR
+#define DMA1_CCR4     sim.DMA1_CCR4
+#define DMA1_CNDTR4   sim.DMA1_CNDTR4
+#define DMA1_CPAR4    sim.DMA1_CPAR4
+#define DMA1_CMAR4    sim.DMA1_CMAR4
+#define DMA1_CCR7     sim.DMA1_CCR7
+#define DMA1_CNDTR7   sim.DMA1_CNDTR7
+#define DMA1_CPAR7    sim.DMA1_CPAR7
+#define DMA1_CMAR7    sim.DMA1_CMAR7
+#define ADC1_SR       sim.ADC1_SR
+#define ADC1_CR1      sim.ADC1_CR1
+#define ADC1_CR2      sim.ADC1_CR2
+#define ADC1_SMPR2    sim.ADC1_SMPR2
+#define ADC1_SQR3     sim.ADC1_SQR3
+#define ADC1_DR       sim.ADC1_DR
+#define SYST_CSR      sim.SYST_CSR
+#define SYST_RVR      sim.SYST_RVR
+#define SYST_CVR      sim.SYST_CVR
+#define NVIC_ISER0    sim.NVIC_ISER0
+
+void sim_irq_disable(void);
+void sim_irq_enable(void);
+#define IRQ_DISABLE() sim_irq_disable()
+#define IRQ_ENABLE()  sim_irq_enable()
+
+/* ================================================================
+   FIRMWARE
+   ================================================================*/
+#define HOST_SIM
+#define main firmware_main
+#include "main.c"
+#undef main
+
+/* ================================================================
+   USART2 + DMA1 CH7 MODEL
+   ================================================================*/
+#define WIRE_MAX      (1 << 18)
+
+uint64_t sim_now;                       // HCLK cycles
+uint64_t sim_byte_cyc;                  // one character time
+uint64_t sim_next_byte;                 // end of the byte on the wire
+uint32_t sim_ch7_len;                   // CNDTR7 at enable, 0 = idle
+uint32_t sim_ch7_mar;
+int      sim_masked, sim_pending;
+
+uint64_t cpu_put, cpu_kick, cpu_irq, cpu_wait;
+uint32_t irq_count;
+
+uint8_t  wire[WIRE_MAX];
+uint32_t wire_len;
+
+/* CMAR7 holds the low 32 bits of a tx_buf address */
+static const volatile uint8_t *sim_mem(uint32_t mar)
+{
+    uint32_t off = mar - (uint32_t)(uintptr_t)tx_buf;
+
+    if (off >= TX_BUF_SIZE)
+    {
+        printf("FAIL: CMAR7 outside tx_buf\n");
+        return tx_buf;
+    }
+    return tx_buf + off;
+}
+
+static void sim_irq(void)
+{
+    sim_pending = 0;
+    irq_count++;
+    DMA1_Channel7_IRQHandler();
+
+    /* IFCR is write-only: CGIF7 clears every ch7 flag */
+    if (DMA1_IFCR & (1 << 24))
+        DMA1_ISR &= ~(0xFu << 24);
+    DMA1_IFCR = 0;
+
+    sim_now += CYC_IRQ;
+    cpu_irq += CYC_IRQ;
+}
+
+/* Take over a transfer UART2_DMA_Start has just programmed */
+static void sim_dma_latch(void)
+{
+    if (sim_ch7_len || !(DMA1_CCR7 & (1 << 0)) || DMA1_CNDTR7 == 0)
+        return;
+
+    if (DMA1_CNDTR7 + (sim_mem(DMA1_CMAR7) - tx_buf) > TX_BUF_SIZE)
+        printf("FAIL: DMA run crosses the end of tx_buf\n");
+
+    sim_ch7_len   = DMA1_CNDTR7;
+    sim_ch7_mar   = DMA1_CMAR7;
+    sim_next_byte = sim_now + sim_byte_cyc;
+}
+
+/* Run the hardware up to cycle t */
+static void sim_run(uint64_t t)
+{
+    sim_dma_latch();
+    while (sim_ch7_len && sim_next_byte <= t)
+    {
+        const volatile uint8_t *mem = sim_mem(sim_ch7_mar);
+
+        sim_now = sim_next_byte;
+        if (wire_len == WIRE_MAX)       // workloads queue half of it
+        {
+            printf("FAIL: DMA sends more bytes than were queued\n");
+            exit(1);
+        }
+        wire[wire_len++] = mem[sim_ch7_len - DMA1_CNDTR7];
+
+        if (--DMA1_CNDTR7)
+        {
+            sim_next_byte += sim_byte_cyc;
+            continue;
+        }
+
+        sim_ch7_len = 0;
+        DMA1_ISR |= (1 << 25) | (1 << 24);  // TCIF7, GIF7
+        if (DMA1_CCR7 & (1 << 1))           // TCIE
+        {
+            sim_pending = 1;
+            if (!sim_masked)
+                sim_irq();
+        }
+        sim_dma_latch();
+    }
+    if (sim_now < t)
+        sim_now = t;
+}
+
+void sim_irq_disable(void)
+{
+    sim_masked = 1;
+}
+
+/* End of UART2_Kick: a pended TC runs now. A kick on a full queue
+   is a pass of the wait loop in UART2_Put, which spins until the
+   next DMA event. */
+void sim_irq_enable(void)
+{
+    sim_masked = 0;
+    if (sim_pending)
+        sim_irq();
+
+    sim_dma_latch();
+    if (RING_FULL(uint16_t, tx_head, tx_tail, TX_BUF_SIZE) && !sim_ch7_len)
+    {
+        printf("FAIL: queue full and DMA idle, UART2_Put spins forever\n");
+        exit(1);
+    }
+    if (RING_FULL(uint16_t, tx_head, tx_tail, TX_BUF_SIZE))
+    {
+        uint64_t t = sim_next_byte > sim_now ? sim_next_byte : sim_now;
+
+        cpu_wait += t - sim_now;
+        sim_run(t);
+        return;
+    }
+    cpu_kick += CYC_KICK;
+    sim_run(sim_now + CYC_KICK);
+}
+
+/* ================================================================
+   WORKLOADS
+   ================================================================*/
+static int fails;
+
+static void sim_reset(void)
+{
+    memset((void *)&sim, 0, sizeof(sim));
+    sim_now = sim_next_byte = 0;
+    sim_ch7_len = 0;
+    sim_masked = sim_pending = 0;
+    cpu_put = cpu_kick = cpu_irq = cpu_wait = 0;
+    irq_count = 0;
+    wire_len = 0;
+
+    UART2_Init();
+    sim_byte_cyc = 10ULL * USART2_BRR * (HCLK_HZ / PCLK1_HZ);
+
+    /* Start just below the uint16_t wrap */
+    tx_head = tx_tail = 0xFFF0;
+    tx_dma_len = 0;
+}
+
+/* Charge the bytes main queued since the last call */
+static void sim_account(uint16_t *head)
+{
+    cpu_put += (uint16_t)(tx_head - *head) * (uint64_t)CYC_PUT;
+    sim_run(sim_now + (uint16_t)(tx_head - *head) * (uint64_t)CYC_PUT);
+    *head = tx_head;
+}
+
+/* Let DMA empty the queue */
+static void sim_drain(void)
+{
+    while (sim_ch7_len)
+        sim_run(sim_next_byte);
+    if (!RING_EMPTY(tx_head, tx_tail) || tx_dma_len)
+    {
+        printf("FAIL: queue not drained (%u left)\n",
+               (unsigned)RING_COUNT(uint16_t, tx_head, tx_tail));
+        fails++;
+    }
+}
+
+static void report(const char *name, uint64_t t_end)
+{
+    double sec  = (double)t_end / HCLK_HZ;
+    double busy = (double)(cpu_put + cpu_kick + cpu_irq + cpu_wait);
+    double line = (double)wire_len * sim_byte_cyc / t_end;
+
+    printf("%-7s %6.1f s %7u B %4.0f B/s  line %5.1f %%  %4u IRQs  "
+           "CPU idle %6.2f %% (wait %5.2f %%), blocking TXE %6.2f %%\n",
+           name, sec, (unsigned)wire_len, wire_len / sec, 100 * line,
+           (unsigned)irq_count, 100 * (1 - busy / t_end),
+           100.0 * cpu_wait / t_end, 100 * (line < 1 ? 1 - line : 0));
+}
+
+static void check_wire(const char *name, const uint8_t *exp, uint32_t len)
+{
+    if (wire_len != len || memcmp(wire, exp, len) != 0)
+    {
+        printf("FAIL %s: wire differs from queued bytes (%u of %u)\n",
+               name, (unsigned)wire_len, (unsigned)len);
+        fails++;
+    }
+}
+
+/* main()'s loop: one FRAME_Add every SAMPLE_PERIOD_MS for 10 s */
+static void run_frames(void)
+{
+    const uint32_t ms = 10000;
+    uint16_t head, seq = 0;
+    uint32_t frames = 0;
+    uint8_t  raw[FRAME_RAW_LEN + 2];
+    uint32_t n = 0;
+
+    sim_reset();
+    frame_n = 0;
+    frame_seq = 0;
+    head = tx_head;
+
+    for (uint32_t t = 0; t < ms; t += SAMPLE_PERIOD_MS)
+    {
+        sim_run((uint64_t)t * (HCLK_HZ / 1000));
+        FRAME_Add((uint16_t)(t * 7 % 4096), t);
+        sim_account(&head);
+    }
+    sim_run((uint64_t)ms * (HCLK_HZ / 1000));
+    report("frames", sim_now);
+    sim_drain();
+
+    /* COBS-decode every frame, check its CRC and sequence */
+    for (uint32_t i = 0, start = 0; i < wire_len; i++)
+    {
+        uint32_t k = start;
+        uint16_t crc;
+
+        if (wire[i] != 0)
+            continue;
+
+        n = 0;
+        while (k < i && n < sizeof(raw))
+        {
+            uint8_t code = wire[k++];
+
+            for (uint8_t j = 1; j < code && k < i && n < sizeof(raw); j++)
+                raw[n++] = wire[k++];
+            if (code < 0xFF && k < i && n < sizeof(raw))
+                raw[n++] = 0;
+        }
+
+        crc = crc16(raw, FRAME_RAW_LEN - 2);
+        if (n != FRAME_RAW_LEN ||
+            raw[FRAME_RAW_LEN - 2] != (uint8_t)crc ||
+            raw[FRAME_RAW_LEN - 1] != (uint8_t)(crc >> 8) ||
+            (uint16_t)(raw[0] | raw[1] << 8) != seq)
+        {
+            printf("FAIL frames: frame %u bad\n", (unsigned)frames);
+            fails++;
+        }
+        seq++;
+        frames++;
+        start = i + 1;
+    }
+    if (frames != ms / SAMPLE_PERIOD_MS / FRAME_SAMPLES)
+    {
+        printf("FAIL frames: %u frames, expected %u\n", (unsigned)frames,
+               (unsigned)(ms / SAMPLE_PERIOD_MS / FRAME_SAMPLES));
+        fails++;
+    }
+}
+
+/* The old print_adc_values() text, 10 times a second for 10 s */
+static void run_text(void)
+{
+    static uint8_t exp[WIRE_MAX];
+    static char    line[64];
+    uint32_t len = 0;
+    uint16_t head;
+
+    sim_reset();
+    head = tx_head;
+
+    for (uint32_t t = 0; t < 10000; t += 100)
+    {
+        int n = snprintf(line, sizeof(line),
+                         "Raw value   : %4u\r\nMapped value: %3u\r\n"
+                         "--------------------\r\n",
+                         (unsigned)(t % 4096), (unsigned)(t % 4096 * 100 / 4095));
+
+        sim_run((uint64_t)t * (HCLK_HZ / 1000));
+        UART2_SendString(line);
+        sim_account(&head);
+        memcpy(exp + len, line, n);
+        len += n;
+    }
+    sim_run(10000ULL * (HCLK_HZ / 1000));
+    report("text", sim_now);
+    sim_drain();
+    check_wire("text", exp, len);
+}
+
+/* Back-to-back strings: the queue stays full, the line never rests */
+static void run_flood(void)
+{
+    static uint8_t exp[WIRE_MAX];
+    static char    line[80];
+    uint32_t len = 0;
+    uint16_t head;
+    uint64_t t_end;
+
+    sim_reset();
+    head = tx_head;
+
+    for (uint32_t i = 0; len + sizeof(line) < WIRE_MAX / 2; i++)
+    {
+        int n = snprintf(line, sizeof(line), "%06u the quick brown fox "
+                         "jumps over the lazy dog %u\r\n",
+                         (unsigned)i, (unsigned)(i * 2654435761u % 1000));
+
+        UART2_SendString(line);
+        sim_account(&head);
+        memcpy(exp + len, line, n);
+        len += n;
+    }
+    sim_drain();
+    t_end = sim_now;
+    report("flood", t_end);
+    check_wire("flood", exp, len);
+}
+
+/* ================================================================
+   RING.H EDGE CASES
+   ------------------------------------------------
+   The largest ring uint8_t indices allow: full must not read as
+   empty, and a DMA run must stop at the buffer end.
+   ================================================================*/
+RING_CHECK(uint8_t, 128, "test");
+
+static void run_ring(void)
+{
+    uint8_t head = 250, tail = 250;     // crosses the index wrap
+    unsigned n = 0;
+
+    while (!RING_FULL(uint8_t, head, tail, 128) && n++ <= 128)
+        head++;
+    if (n != 128 || RING_COUNT(uint8_t, head, tail) != 128 ||
+        RING_EMPTY(head, tail))
+    {
+        printf("FAIL ring: full uint8_t/128 ring reads %u\n",
+               (unsigned)RING_COUNT(uint8_t, head, tail));
+        fails++;
+    }
+    for (n = 0; !RING_EMPTY(head, tail) && n <= 128; n++)
+    {
+        uint8_t count = RING_COUNT(uint8_t, head, tail);
+        unsigned len = RING_RUN(count, tail, 128);
+
+        if (RING_SLOT(tail, 128) + len > 128 ||
+            (len != count && RING_SLOT(tail, 128) + len != 128))
+        {
+            printf("FAIL ring: run of %u at slot %u\n", len,
+                   (unsigned)RING_SLOT(tail, 128));
+            fails++;
+        }
+        tail += len;
+    }
+    if (n != 2)                         // 250..255 is slot 122..127
+    {
+        printf("FAIL ring: drained in %u runs, expected 2\n", n);
+        fails++;
+    }
+}
+
+/* ================================================================
+   MAIN
+   ================================================================*/
+int main(void)
+{
+    sim_byte_cyc = 10ULL * USART_BRR(PCLK1_HZ, DEBUG_BAUD) * (HCLK_HZ / PCLK1_HZ);
+    printf("USART2 %u baud: %u cycles/byte, line rate %.0f B/s; "
+           "model CYC_PUT %u, CYC_KICK %u, CYC_IRQ %u\n",
+           DEBUG_BAUD, (unsigned)sim_byte_cyc, (double)HCLK_HZ / sim_byte_cyc,
+           CYC_PUT, CYC_KICK, CYC_IRQ);
+
+    run_frames();
+    run_text();
+    run_flood();
+    run_ring();
+
+    printf("%s (%d failures)\n", fails ? "FAILED" : "OK", fails);
+    return fails != 0;
+}
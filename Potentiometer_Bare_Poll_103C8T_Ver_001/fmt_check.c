@@ -0,0 +1,246 @@
+/* ================================================================
+   HOST CHECK FOR THE FORMATTERS IN main.c
+   ------------------------------------------------------------
+   Not part of the Keil project. Builds main.c on a PC with its
+   main() renamed and only calls the pure formatters, so no
+   register is ever touched:
+
+       gcc -O2 -Wno-pointer-to-int-cast fmt_check.c -o fmt_check
+       ./fmt_check            (full DIV100 sweep, ~10 s)
+       ./fmt_check quick      (skip the sweep)
+
+   Checks:
+     - DIV100(v) == v / 100 for every 32-bit v
+     - fmt_u32 / fmt_i32 / fmt_hex32 / fmt_fixed == snprintf
+       over 20M pseudo-random values plus the edge cases
+   Timing, per call, for the line main.c used to print ("1234\r\n"):
+     - int_to_str   the old formatter, copied from before the change
+     - fmt_u32      plus the "\r\n" main.c appends
+     - snprintf     newlib-style "%u\r\n" (here: the host libc)
+   on 12-bit ADC values and, where the formatter allows it, on full
+   32-bit values. These are host figures: ns and TSC cycles per call
+   on the PC, not Cortex-M3 cycles. The PC also turns / 10 into a
+   multiply, so the gap to int_to_str is smaller than on the target.
+   ================================================================*/
+#define main firmware_main
+#include "main.c"
+#undef main
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TSC()   __rdtsc()
+#else
+#define TSC()   0ULL
+#endif
+
+/* ================================================================
+   HELPERS
+   ================================================================*/
+static uint32_t rng = 2463534242u;
+
+static uint32_t xorshift32(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+static int fails;
+
+static void expect(const char *got, const char *want, const char *what, long long v)
+{
+    if (strcmp(got, want) && fails++ < 10)
+        printf("FAIL %s(%lld): got \"%s\" want \"%s\"\n", what, v, got, want);
+}
+
+/* Reference for fmt_fixed, built with snprintf and no float */
+static void ref_fixed(char *out, int32_t v, int dec)
+{
+    uint32_t u = v < 0 ? 0u - (uint32_t)v : (uint32_t)v;
+    uint32_t p = 1;
+
+    for (int i = 0; i < dec; i++)
+        p *= 10;
+
+    if (dec)
+        sprintf(out, "%s%lu.%0*lu", v < 0 ? "-" : "", (unsigned long)(u / p),
+                dec, (unsigned long)(u % p));
+    else
+        sprintf(out, "%s%lu", v < 0 ? "-" : "", (unsigned long)u);
+}
+
+static void check_one(uint32_t v)
+{
+    char got[40], want[40];
+    int dec = v % 10;
+
+    fmt_u32(got, v);
+    sprintf(want, "%lu", (unsigned long)v);
+    expect(got, want, "fmt_u32", v);
+
+    fmt_i32(got, (int32_t)v);
+    sprintf(want, "%ld", (long)(int32_t)v);
+    expect(got, want, "fmt_i32", (int32_t)v);
+
+    fmt_hex32(got, v, 2);
+    sprintf(want, "%02lX", (unsigned long)v);
+    expect(got, want, "fmt_hex32", v);
+
+    fmt_fixed(got, (int32_t)v, dec);
+    ref_fixed(want, (int32_t)v, dec);
+    expect(got, want, "fmt_fixed", (int32_t)v);
+}
+
+
+/* ================================================================
+   TIMING
+   ================================================================*/
+#define BENCH_N     4096                    // inputs, power of two
+#define BENCH_CALLS 20000000
+
+/* The old formatter from main.c, as it was: uint16_t only */
+static void int_to_str(uint16_t val, char *buf)
+{
+    int i = 0;
+    int j = 0;
+    char temp[6];
+
+    if (val == 0)
+        buf[i++] = '0';
+    else
+    {
+        /* Extract digits */
+        while (val)
+        {
+            temp[j++] = (val % 10) + '0';
+            val /= 10;
+        }
+
+        /* Reverse digits */
+        while (j)
+            buf[i++] = temp[--j];
+    }
+
+    /* Append newline */
+    buf[i++] = '\r';
+    buf[i++] = '\n';
+    buf[i] = '\0';
+}
+
+static uint32_t bench_in[BENCH_N];
+static volatile uint32_t bench_sink;
+
+static void line_int_to_str(char *buf, uint32_t v)
+{
+    int_to_str((uint16_t)v, buf);
+}
+
+static void line_fmt_u32(char *buf, uint32_t v)
+{
+    char *p = fmt_u32(buf, v);
+
+    *p++ = '\r';
+    *p++ = '\n';
+    *p = '\0';
+}
+
+static void line_snprintf(char *buf, uint32_t v)
+{
+    snprintf(buf, 16, "%lu\r\n", (unsigned long)v);
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void bench(const char *name, void (*line)(char *, uint32_t))
+{
+    char     buf[16];
+    uint32_t sum = 0;
+    uint64_t c0;
+    double   t0, ns;
+
+    t0 = now_ns();
+    c0 = TSC();
+    for (uint32_t i = 0; i < BENCH_CALLS; i++)
+    {
+        line(buf, bench_in[i & (BENCH_N - 1)]);
+        sum += (uint8_t)buf[0] + (uint8_t)buf[2];
+    }
+    ns = (now_ns() - t0) / BENCH_CALLS;
+    bench_sink = sum;
+
+    printf("  %-10s %6.1f ns/call %7.1f cycles/call\n", name, ns,
+           (double)(TSC() - c0) / BENCH_CALLS);
+}
+
+static void bench_all(void)
+{
+    char a[16], b[16], c[16];
+
+    /* 12-bit ADC values: all three formatters print the same line */
+    for (uint32_t i = 0; i < BENCH_N; i++)
+    {
+        bench_in[i] = xorshift32() & 0xFFF;
+        line_int_to_str(a, bench_in[i]);
+        line_fmt_u32(b, bench_in[i]);
+        line_snprintf(c, bench_in[i]);
+        expect(a, c, "int_to_str", bench_in[i]);
+        expect(b, c, "fmt_u32 line", bench_in[i]);
+    }
+    printf("timing : 12-bit values (0..4095)\n");
+    bench("int_to_str", line_int_to_str);
+    bench("fmt_u32", line_fmt_u32);
+    bench("snprintf", line_snprintf);
+
+    /* Full 32-bit range: int_to_str only takes uint16_t */
+    for (uint32_t i = 0; i < BENCH_N; i++)
+        bench_in[i] = xorshift32() >> (i & 31);
+    printf("timing : 32-bit values, all digit counts\n");
+    bench("fmt_u32", line_fmt_u32);
+    bench("snprintf", line_snprintf);
+}
+
+
+/* ================================================================
+   MAIN
+   ================================================================*/
+int main(int argc, char **argv)
+{
+    static const uint32_t edge[] = {
+        0, 1, 9, 10, 99, 100, 101, 999, 1000, 4095, 65535,
+        99999999, 100000000, 999999999, 1000000000,
+        0x7FFFFFFF, 0x80000000, 0xFFFFFFFF
+    };
+
+    if (argc < 2 || strcmp(argv[1], "quick"))
+    {
+        uint32_t v = 0;
+
+        do
+        {
+            if (DIV100(v) != v / 100 && fails++ < 10)
+                printf("FAIL DIV100(%lu)\n", (unsigned long)v);
+        } while (++v);
+        printf("DIV100 : all 2^32 values checked\n");
+    }
+
+    for (unsigned i = 0; i < sizeof(edge) / sizeof(edge[0]); i++)
+        check_one(edge[i]);
+    for (uint32_t i = 0; i < 20000000; i++)
+        check_one(xorshift32() >> (i & 31));
+    printf("format : 20M values against snprintf\n");
+
+    bench_all();
+
+    printf("%s (%d failures)\n", fails ? "FAILED" : "OK", fails);
+    return fails != 0;
+}
@@ -15,6 +15,11 @@
    - Address = 0x4002101C */
 #define RCC_APB1ENR     (*(volatile uint32_t*)0x4002101C)
 
+/* RCC_AHBENR
+   - Enables clocks for DMA1, SRAM, FLITF, etc.
+   - Address = 0x40021014 */
+#define RCC_AHBENR      (*(volatile uint32_t*)0x40021014)
+
 /* RCC_CFGR
    - Used to configure system clocks   RCC_CFGR = Clock Configuration Register
    - Here used to set ADC prescaler
@@ -31,6 +36,7 @@
    - PA2  -> USART2 TX
    - PA3  -> USART2 RX
    - PA4  -> ADC input
+   - PA9  -> USART1 TX (telemetry)
    ================================================================*/
 
 /* GPIOA_CRL
@@ -38,6 +44,11 @@
    - Address = 0x40010800 */
 #define GPIOA_CRL       (*(volatile uint32_t*)0x40010800)
 
+/* GPIOA_CRH
+   - Controls configuration of PA8 to PA15
+   - Address = 0x40010804 */
+#define GPIOA_CRH       (*(volatile uint32_t*)0x40010804)
+
 
 /* ================================================================
    USART2 REGISTERS
@@ -56,6 +67,84 @@
 /* USART2_CR1 : Control register (TX, RX, USART enable) */
 #define USART2_CR1      (*(volatile uint32_t*)0x4000440C)
 
+/* USART2_CR3 : Control register 3 (DMAT = DMA on TXE) */
+#define USART2_CR3      (*(volatile uint32_t*)0x40004414)
+
+
+/* ================================================================
+   USART1 REGISTERS
+   Used for high speed telemetry (APB2 clock = 72 MHz)
+   ================================================================*/
+
+/* USART1_DR  : Data register, written by DMA */
+#define USART1_DR       (*(volatile uint32_t*)0x40013804)
+
+/* USART1_BRR : Baud rate register */
+#define USART1_BRR      (*(volatile uint32_t*)0x40013808)
+
+/* USART1_CR1 : Control register (TX, USART enable) */
+#define USART1_CR1      (*(volatile uint32_t*)0x4001380C)
+
+/* USART1_CR3 : Control register 3 (DMAT = DMA on TXE) */
+#define USART1_CR3      (*(volatile uint32_t*)0x40013814)
+
+
+/* ================================================================
+   DMA1 CHANNEL 4 REGISTERS
+   Channel 4 is hard-wired to USART1_TX
+   ================================================================*/
+
+/* DMA1_ISR / DMA1_IFCR : Status flags / flag clear */
+#define DMA1_ISR        (*(volatile uint32_t*)0x40020000)
+#define DMA1_IFCR       (*(volatile uint32_t*)0x40020004)
+
+/* DMA1_CCR4 : Channel control (EN, TCIE, DIR, MINC) */
+#define DMA1_CCR4       (*(volatile uint32_t*)0x40020044)
+
+/* DMA1_CNDTR4 : Number of bytes to transfer */
+#define DMA1_CNDTR4     (*(volatile uint32_t*)0x40020048)
+
+/* DMA1_CPAR4 / DMA1_CMAR4 : Peripheral / memory address */
+#define DMA1_CPAR4      (*(volatile uint32_t*)0x4002004C)
+#define DMA1_CMAR4      (*(volatile uint32_t*)0x40020050)
+
+
+/* ================================================================
+   DMA1 CHANNEL 7 REGISTERS
+   Channel 7 is hard-wired to USART2_TX
+   ================================================================*/
+
+/* DMA1_CCR7 : Channel control (EN, DIR, MINC) */
+#define DMA1_CCR7       (*(volatile uint32_t*)0x40020080)
+
+/* DMA1_CNDTR7 : Bytes left; 0 once the line is sent */
+#define DMA1_CNDTR7     (*(volatile uint32_t*)0x40020084)
+
+/* DMA1_CPAR7 / DMA1_CMAR7 : Peripheral / memory address */
+#define DMA1_CPAR7      (*(volatile uint32_t*)0x40020088)
+#define DMA1_CMAR7      (*(volatile uint32_t*)0x4002008C)
+
+
+/* ================================================================
+   NVIC REGISTERS
+   ================================================================*/
+
+/* NVIC_ISER0 : Interrupt set-enable for IRQ0..31 */
+#define NVIC_ISER0      (*(volatile uint32_t*)0xE000E100)
+
+
+/* ================================================================
+   SYSTICK REGISTERS
+   1 ms time base for frame timestamps
+   ================================================================*/
+
+/* SYST_CSR : Control (ENABLE, TICKINT, CLKSOURCE) */
+#define SYST_CSR        (*(volatile uint32_t*)0xE000E010)
+
+/* SYST_RVR / SYST_CVR : Reload / current value */
+#define SYST_RVR        (*(volatile uint32_t*)0xE000E014)
+#define SYST_CVR        (*(volatile uint32_t*)0xE000E018)
+
 
 /* ================================================================
    ADC1 REGISTERS
@@ -78,6 +167,71 @@
 #define ADC1_DR         (*(volatile uint32_t*)0x4001244C)
 
 
+/* ================================================================
+   CLOCK TREE (COMPILE TIME)
+   Every divider below is derived from these clocks,
+   so a clock change cannot leave a stale magic number.
+   ================================================================*/
+
+/* Same selection as SetSysClockTo72() in system_stm32f10x.c:
+   HSE 8 MHz x PLL 9 = SYSCLK 72 MHz, AHB /1, APB1 /2, APB2 /1 */
+#define HSE_HZ        8000000UL
+#define SYSCLK_HZ     (HSE_HZ * 9)
+#define HCLK_HZ       (SYSCLK_HZ / 1)
+#define PCLK1_HZ      (HCLK_HZ / 2)       // APB1: USART2/3, I2C1
+#define PCLK2_HZ      (HCLK_HZ / 1)       // APB2: USART1, SPI1, ADC1
+
+/* USART, 16x oversampling: BRR = PCLK / baud, error in 0.1 % steps */
+#define USART_BRR(pclk, baud)   (((pclk) + (baud) / 2) / (baud))
+#define USART_REAL(pclk, baud)  ((pclk) / USART_BRR(pclk, baud))
+#define USART_ERR(pclk, baud)                                   \
+    ((USART_REAL(pclk, baud) > (baud) ?                         \
+      USART_REAL(pclk, baud) - (baud) :                         \
+      (baud) - USART_REAL(pclk, baud)) * 1000 / (baud))
+#define USART_CHECK(pclk, baud, name)                           \
+    _Static_assert(USART_BRR(pclk, baud) >= 16 &&               \
+                   USART_ERR(pclk, baud) <= 20,                 \
+                   name " baud rate out of tolerance")
+
+/* ADC: smallest ADCPRE (/2 /4 /6 /8) keeping ADCCLK <= 14 MHz */
+#define ADC_MAX_HZ    14000000UL
+#define ADCPRE_BITS   (PCLK2_HZ / 2 <= ADC_MAX_HZ ? 0 :         \
+                       PCLK2_HZ / 4 <= ADC_MAX_HZ ? 1 :         \
+                       PCLK2_HZ / 6 <= ADC_MAX_HZ ? 2 : 3)
+#define ADCCLK_HZ     (PCLK2_HZ / (2 * (ADCPRE_BITS + 1)))
+_Static_assert(ADCCLK_HZ <= ADC_MAX_HZ, "ADCCLK above 14 MHz");
+
+#define DEBUG_BAUD    9600
+/* USART1 telemetry: BRR = PCLK2 / baud
+   e.g. 4500000 -> 0x10, 2250000 -> 0x20 */
+#define TELEM_BAUD    2250000
+USART_CHECK(PCLK1_HZ, DEBUG_BAUD, "USART2");
+USART_CHECK(PCLK2_HZ, TELEM_BAUD, "USART1");
+
+
+/* ================================================================
+   TELEMETRY SETTINGS
+   ================================================================*/
+
+/* Samples per DMA block; each block starts with TELEM_SYNC.
+   ADC data is 12-bit so the sync word never appears as a sample. */
+#define TELEM_BLOCK     64
+#define TELEM_SYNC      0xA55A
+
+/* USART2 binary frames, same format as the IRQ project
+   (decode with Potentiometer_Bare_IRQ_103C8T_Ver_001/telemetry_decode.py)
+   8 samples = 26 bytes on the wire (~3 B/sample vs ~50 B as text).
+   250 S/s x 26 / 8 = 812 B/s fits the 960 B/s of 9600 baud.
+   A frame goes out by DMA; if the last one is still on the wire
+   it is skipped, so the ADC loop never waits on 9600 baud. */
+#define SAMPLE_PERIOD_MS 4
+#define FRAME_SAMPLES   8                   // Must be even
+#define FRAME_CH_MASK   (1 << 4)            // ADC1 channel 4 (PA4)
+#define FRAME_HDR_LEN   10
+#define FRAME_RAW_LEN   (FRAME_HDR_LEN + FRAME_SAMPLES * 3 / 2 + 2)
+#define FRAME_COBS_MAX  (FRAME_RAW_LEN + FRAME_RAW_LEN / 254 + 2)
+
+
 /* ================================================================
    GLOBAL VARIABLES
    ================================================================*/
@@ -85,8 +239,30 @@
 /* Stores 12-bit ADC value (04095) */
 uint16_t adc_val;
 
-/* Buffer for UART transmission */
-char msg[20];
+/* Updated inside SysTick ISR */
+volatile uint32_t ms_ticks = 0;
+
+/* Frame being filled by the main loop */
+uint8_t  frame[FRAME_RAW_LEN];
+uint8_t  frame_n = 0;
+uint16_t frame_seq = 0;
+
+/* COBS-encoded frame, read by DMA1 channel 7 */
+uint8_t msg[FRAME_COBS_MAX];
+
+/* Frames skipped because the previous one was still sending */
+uint32_t frame_drops = 0;
+
+/* Telemetry ping-pong blocks: one filled by main, one sent by DMA */
+uint16_t telem_blk[2][TELEM_BLOCK + 1];
+uint8_t  telem_fill = 0;
+uint8_t  telem_idx  = 1;
+
+/* Set while DMA owns a block, cleared by the DMA interrupt */
+volatile uint8_t telem_busy = 0;
+
+/* Blocks lost because the previous one was still being sent */
+volatile uint32_t telem_drops = 0;
 
 
 /* ================================================================
@@ -100,6 +276,23 @@ void delay(int t)
 }
 
 
+/* ================================================================
+   FUNCTION: SysTick_Init()
+   PURPOSE : 1 ms tick, counted in ms_ticks
+   ================================================================*/
+void SysTick_Init(void)
+{
+    SYST_RVR = HCLK_HZ / 1000 - 1;
+    SYST_CVR = 0;
+    SYST_CSR = (1 << 2) | (1 << 1) | (1 << 0);  /* HCLK, TICKINT, ENABLE */
+}
+
+void SysTick_Handler(void)
+{
+    ms_ticks++;
+}
+
+
 /* ================================================================
    FUNCTION: UART2_Init()
    PURPOSE : Initialize USART2 for serial communication
@@ -161,8 +354,10 @@ void UART2_Init(void)
        Fraction = 0.375  16  6
 
        BRR = (234 << 4) | 6 = 0xEA6
+
+       USART_BRR() does the same at compile time
     ------------------------------------------------------------ */
-    USART2_BRR = 0xEA6;
+    USART2_BRR = USART_BRR(PCLK1_HZ, DEBUG_BAUD);
 
     /* Enable USART */
     USART2_CR1 |= (1 << 13);
@@ -172,6 +367,17 @@ void UART2_Init(void)
 
     /* Enable Receiver */
     USART2_CR1 |= (1 << 2);
+
+    /* ------------------------------------------------------------
+       DMA1 Channel 7 for the frames (TX only)
+       DIR  = 1 (memory -> peripheral)
+       MINC = 1 (walk through msg[])
+       No interrupt: CNDTR7 = 0 tells that the frame is out
+    ------------------------------------------------------------ */
+    RCC_AHBENR |= (1 << 0);
+    DMA1_CCR7  = 0;
+    DMA1_CPAR7 = (uint32_t)&USART2_DR;
+    DMA1_CCR7  = (1 << 7) | (1 << 4);
 }
 
 
@@ -201,6 +407,28 @@ void UART2_SendString(char *s)
 }
 
 
+/* ================================================================
+   FUNCTION: UART2_SendDMA()
+   PURPOSE : Start sending len bytes of msg[] without waiting
+   RETURNS : 0 if the previous frame is still being sent
+   ================================================================*/
+int UART2_SendDMA(uint16_t len)
+{
+    if (DMA1_CNDTR7)
+        return 0;
+
+    /* CNDTR can only be written while the channel is off */
+    DMA1_CCR7  &= ~(1 << 0);
+    DMA1_CMAR7  = (uint32_t)msg;
+    DMA1_CNDTR7 = len;
+
+    /* USART2 requests DMA on TXE from now on */
+    USART2_CR3 |= (1 << 7);
+    DMA1_CCR7  |=  (1 << 0);
+    return 1;
+}
+
+
 /* ================================================================
    FUNCTION: ADC_Init()
    PURPOSE : Initialize ADC1 to read PA4 (Potentiometer)
@@ -218,9 +446,10 @@ void ADC_Init(void)
        Set ADC prescaler
        ADCCLK = PCLK2 / 6 = 72 / 6 = 12 MHz
        (ADC clock must be <= 14 MHz)
+       ADCPRE_BITS picks this divider at compile time
     ------------------------------------------------------------ */
     RCC_CFGR &= ~(3 << 14);
-    RCC_CFGR |=  (2 << 14);
+    RCC_CFGR |=  (ADCPRE_BITS << 14);
 
     /* ------------------------------------------------------------
        Configure PA4 as Analog Input
@@ -276,64 +505,374 @@ uint16_t ADC_Read(void)
 
 
 /* ================================================================
-   FUNCTION: int_to_str()
-   PURPOSE : Convert integer to ASCII string
+   FUNCTION: fmt_u32() / fmt_i32() / fmt_hex32() / fmt_fixed()
+   PURPOSE : Convert integers to ASCII without any divide
+   ------------------------------------------------------------
+   Old int_to_str() did one % and one / per digit.
+   Here:
+     - digits2[] holds "00".."99", so each step emits 2 digits
+     - v / 100 is done as (v * 1374389535) >> 37
+       (exact for every 32-bit value, one UMULL on Cortex-M3)
+   Every function writes '\0' and returns a pointer to it,
+   so calls can be chained to build a line.
    ================================================================*/
-void int_to_str(uint16_t val, char *buf)
+/* "00".."99": one table read emits two digits */
+const char digits2[201] =
+    "00010203040506070809" "10111213141516171819"
+    "20212223242526272829" "30313233343536373839"
+    "40414243444546474849" "50515253545556575859"
+    "60616263646566676869" "70717273747576777879"
+    "80818283848586878889" "90919293949596979899";
+
+/* n / 100 as multiply + shift, exact for every uint32_t */
+#define DIV100(n)   ((uint32_t)(((uint64_t)(n) * 1374389535u) >> 37))
+
+/* Unsigned decimal. Writes '\0', returns pointer to it */
+char *fmt_u32(char *buf, uint32_t v)
 {
-    int i = 0;
-    int j = 0;
-    char temp[6];
+    char tmp[10];
+    char *p = tmp + sizeof(tmp);
+
+    while (v >= 100)
+    {
+        uint32_t q = DIV100(v);
+        uint32_t r = (v - q * 100) * 2;
+
+        *--p = digits2[r + 1];
+        *--p = digits2[r];
+        v = q;
+    }
+
+    if (v >= 10)
+    {
+        *--p = digits2[v * 2 + 1];
+        *--p = digits2[v * 2];
+    }
+    else
+    {
+        *--p = '0' + v;
+    }
+
+    while (p < tmp + sizeof(tmp))
+        *buf++ = *p++;
+    *buf = '\0';
+    return buf;
+}
+
+/* Signed decimal */
+char *fmt_i32(char *buf, int32_t v)
+{
+    if (v < 0)
+    {
+        *buf++ = '-';
+        return fmt_u32(buf, 0u - (uint32_t)v);
+    }
+    return fmt_u32(buf, (uint32_t)v);
+}
+
+/* Upper-case hex, at least 'width' digits (1..8) */
+char *fmt_hex32(char *buf, uint32_t v, int width)
+{
+    int n = 8;
+
+    while (n > width && (v >> ((n - 1) * 4)) == 0)
+        n--;
+
+    while (n--)
+        *buf++ = "0123456789ABCDEF"[(v >> (n * 4)) & 0xF];
+    *buf = '\0';
+    return buf;
+}
+
+/* Fixed point: v holds value x 10^dec, e.g. (1234, 2) -> "12.34".
+   Digits come from fmt_u32, the point is inserted, no divide.
+   dec is clamped to 0..FMT_DEC_MAX: an int32 has at most 10 digits,
+   so tmp[] never holds more than 10 plus the '\0' from fmt_u32. */
+#define FMT_DEC_MAX     9
+
+char *fmt_fixed(char *buf, int32_t v, int dec)
+{
+    char tmp[12];
+    int len, pad;
+
+    if (dec < 0)
+        dec = 0;
+    if (dec > FMT_DEC_MAX)
+        dec = FMT_DEC_MAX;
 
-    if (val == 0)
-        buf[i++] = '0';
+    if (v < 0)
+    {
+        *buf++ = '-';
+        len = fmt_u32(tmp, 0u - (uint32_t)v) - tmp;
+    }
     else
     {
-        /* Extract digits */
-        while (val)
+        len = fmt_u32(tmp, (uint32_t)v) - tmp;
+    }
+
+    /* Leading zeros so there is one digit before the point */
+    for (pad = dec + 1 - len; pad > 0; pad--, len++)
+    {
+        for (int i = len; i > 0; i--)
+            tmp[i] = tmp[i - 1];
+        tmp[0] = '0';
+    }
+
+    for (int i = 0; i < len; i++)
+    {
+        if (dec && i == len - dec)
+            *buf++ = '.';
+        *buf++ = tmp[i];
+    }
+    *buf = '\0';
+    return buf;
+}
+
+
+/* ================================================================
+   FUNCTION: TELEM_Init()
+   PURPOSE : Initialize USART1 + DMA1 Channel 4 for telemetry
+   CONFIG  :
+       Baud rate : TELEM_BAUD
+       Data      : 8-bit, no parity, 1 stop
+       Direction : TX only (PA9)
+   ================================================================*/
+void TELEM_Init(void)
+{
+    /* Enable GPIOA, USART1 and DMA1 clocks */
+    RCC_APB2ENR |= (1 << 2);
+    RCC_APB2ENR |= (1 << 14);
+    RCC_AHBENR  |= (1 << 0);
+
+    /* ------------------------------------------------------------
+       PA9 -> USART1_TX
+       MODE = 11 (50 MHz output)
+       CNF  = 10 (Alternate Function Push-Pull)
+    ------------------------------------------------------------ */
+    GPIOA_CRH &= ~(0xF << 4);
+    GPIOA_CRH |=  (0xB << 4);
+
+    /* ------------------------------------------------------------
+       Baud Rate Calculation:
+       USARTDIV = PCLK2 / (16 x Baudrate)
+       BRR      = 16 x USARTDIV = PCLK2 / Baudrate
+       2250000 baud -> 72,000,000 / 2,250,000 = 32 = 0x20
+    ------------------------------------------------------------ */
+    USART1_BRR = USART_BRR(PCLK2_HZ, TELEM_BAUD);
+
+    /* Let USART1 request DMA when TXE = 1 */
+    USART1_CR3 |= (1 << 7);
+
+    /* Enable USART + Transmitter */
+    USART1_CR1 |= (1 << 13) | (1 << 3);
+
+    /* ------------------------------------------------------------
+       DMA1 Channel 4
+       DIR  = 1 (memory -> peripheral)
+       MINC = 1 (walk through the block)
+       TCIE = 1 (interrupt when block is sent)
+    ------------------------------------------------------------ */
+    DMA1_CCR4  = 0;
+    DMA1_CPAR4 = (uint32_t)&USART1_DR;
+    DMA1_CCR4  = (1 << 7) | (1 << 4) | (1 << 1);
+
+    /* Enable DMA1 Channel 4 interrupt (IRQ14) */
+    NVIC_ISER0 |= (1 << 14);
+
+    telem_blk[0][0] = TELEM_SYNC;
+    telem_blk[1][0] = TELEM_SYNC;
+}
+
+
+/* ================================================================
+   FUNCTION: TELEM_Put()
+   PURPOSE : Add one sample; start DMA when a block is full
+   ================================================================*/
+void TELEM_Put(uint16_t sample)
+{
+    telem_blk[telem_fill][telem_idx++] = sample;
+
+    if (telem_idx <= TELEM_BLOCK)
+        return;
+
+    telem_idx = 1;
+
+    /* Previous block still on the wire -> drop this one */
+    if (telem_busy)
+    {
+        telem_drops++;
+        return;
+    }
+
+    telem_busy  = 1;
+    DMA1_CCR4  &= ~(1 << 0);
+    DMA1_CMAR4  = (uint32_t)telem_blk[telem_fill];
+    DMA1_CNDTR4 = sizeof(telem_blk[0]);
+    DMA1_CCR4  |=  (1 << 0);
+
+    /* Keep filling the other block */
+    telem_fill ^= 1;
+}
+
+
+/* ================================================================
+   FUNCTION: DMA1_Channel4_IRQHandler()
+   PURPOSE : Block sent -> DMA is free again
+   ================================================================*/
+void DMA1_Channel4_IRQHandler(void)
+{
+    if (DMA1_ISR & (1 << 13))   /* TCIF4 */
+    {
+        DMA1_IFCR = (1 << 12);  /* CGIF4 clears all channel 4 flags */
+        telem_busy = 0;
+    }
+}
+
+
+/* ================================================================
+   FUNCTION: crc16()
+   PURPOSE : CRC-16/CCITT (poly 0x1021, init 0xFFFF)
+   ================================================================*/
+uint16_t crc16(const uint8_t *p, uint16_t len)
+{
+    uint16_t crc = 0xFFFF;
+
+    while (len--)
+    {
+        crc ^= (uint16_t)(*p++) << 8;
+        for (int i = 0; i < 8; i++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+    }
+    return crc;
+}
+
+
+/* ================================================================
+   FUNCTION: COBS_Encode()
+   PURPOSE : Remove every 0x00 from the frame so 0x00 can mark
+             the frame end. Overhead: 1 byte per 254 + delimiter.
+   RETURNS : Bytes written to out, delimiter included
+   ================================================================*/
+uint16_t COBS_Encode(uint8_t *out, const uint8_t *p, uint16_t len)
+{
+    uint16_t code_at = 0, o = 1;
+    uint8_t  code = 1;
+
+    for (uint16_t i = 0; i < len; i++)
+    {
+        if (p[i] != 0)
         {
-            temp[j++] = (val % 10) + '0';
-            val /= 10;
+            out[o++] = p[i];
+            code++;
         }
 
-        /* Reverse digits */
-        while (j)
-            buf[i++] = temp[--j];
+        if (p[i] == 0 || code == 0xFF)
+        {
+            out[code_at] = code;
+            code_at = o++;
+            code = 1;
+        }
     }
+    out[code_at] = code;
+    out[o++] = 0x00;                    /* Frame delimiter */
+    return o;
+}
 
-    /* Append newline */
-    buf[i++] = '\r';
-    buf[i++] = '\n';
-    buf[i] = '\0';
+
+/* ================================================================
+   FUNCTION: FRAME_Add()
+   PURPOSE : Pack one sample; send the frame when it is full
+   FORMAT  : Raw frame (little-endian), then COBS + 0x00 on the wire
+       | seq u16 | t_ms u32 | ch_mask u16 | period_ms u8 | n u8 |
+       | n x 12-bit samples, 2 per 3 bytes | crc16 u16 |
+       t_ms is the time of the first sample.
+   ================================================================*/
+void FRAME_Add(uint16_t sample, uint32_t t_ms)
+{
+    uint8_t *d = &frame[FRAME_HDR_LEN + (frame_n / 2) * 3];
+
+    if (frame_n == 0)
+    {
+        frame[2] = t_ms;
+        frame[3] = t_ms >> 8;
+        frame[4] = t_ms >> 16;
+        frame[5] = t_ms >> 24;
+    }
+
+    /* Pack two 12-bit samples into three bytes */
+    if ((frame_n & 1) == 0)
+    {
+        d[0] = sample;
+        d[1] = (sample >> 8) & 0x0F;
+    }
+    else
+    {
+        d[1] |= (sample & 0x0F) << 4;
+        d[2] = sample >> 4;
+    }
+
+    if (++frame_n < FRAME_SAMPLES)
+        return;
+
+    frame[0] = frame_seq;
+    frame[1] = frame_seq >> 8;
+    frame[6] = FRAME_CH_MASK;
+    frame[7] = FRAME_CH_MASK >> 8;
+    frame[8] = SAMPLE_PERIOD_MS;
+    frame[9] = FRAME_SAMPLES;
+
+    uint16_t crc = crc16(frame, FRAME_RAW_LEN - 2);
+    frame[FRAME_RAW_LEN - 2] = crc;
+    frame[FRAME_RAW_LEN - 1] = crc >> 8;
+
+    /* Last frame still on the wire: skip, msg[] belongs to DMA.
+       seq still counts, so the decoder sees the gap. */
+    if (DMA1_CNDTR7)
+        frame_drops++;
+    else
+        UART2_SendDMA(COBS_Encode(msg, frame, FRAME_RAW_LEN));
+
+    frame_seq++;
+    frame_n = 0;
 }
 
 
 /* ================================================================
    MAIN FUNCTION
-   PURPOSE : Continuously read ADC value and print on Tera Term
+   PURPOSE : Stream every ADC value on USART1 and send one
+             sample every SAMPLE_PERIOD_MS as binary frames
+             on USART2
    ================================================================*/
 int main(void)
 {
-    /* Initialize UART and ADC */
+    uint32_t next;
+
+    /* Initialize UART, telemetry, ADC and the 1 ms tick */
     UART2_Init();
+    TELEM_Init();
     ADC_Init();
+    SysTick_Init();
+
+    /* Text banner, then 0x00 so the decoder syncs on the first frame */
+    UART2_SendString("ADC Pot Value (binary frames):\r\n");
+    UART2_SendChar(0x00);
 
-    /* Send header message */
-    UART2_SendString("ADC Pot Value:\r\n");
+    next = ms_ticks;
 
     while (1)
     {
         /* Read potentiometer value */
         adc_val = ADC_Read();
 
-        /* Convert ADC value to string */
-        int_to_str(adc_val, msg);
+        /* Every sample goes out on USART1 */
+        TELEM_Put(adc_val);
 
-        /* Send value to Tera Term */
-        UART2_SendString(msg);
-
-        /* Delay between readings */
-        delay(500);
+        /* One sample every SAMPLE_PERIOD_MS, framed and sent by DMA */
+        if ((int32_t)(ms_ticks - next) >= 0)
+        {
+            FRAME_Add(adc_val, next);
+            next += SAMPLE_PERIOD_MS;
+        }
     }
 }
 
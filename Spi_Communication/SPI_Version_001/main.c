@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <stdarg.h>
 
 /* ================= RCC ================= */
 #define RCC_APB2ENR (*(volatile uint32_t*)0x40021018)
@@ -20,6 +21,59 @@
 #define SPI1_SR     (*(volatile uint32_t*)0x40013008)
 #define SPI1_DR     (*(volatile uint32_t*)0x4001300C)
 
+/* ================= CLOCK TREE ================= */
+/* Same selection as SetSysClockTo72() in system_stm32f10x.c:
+   HSE 8 MHz x PLL 9 = SYSCLK 72 MHz, AHB /1, APB1 /2, APB2 /1 */
+#define HSE_HZ        8000000UL
+#define SYSCLK_HZ     (HSE_HZ * 9)
+#define HCLK_HZ       (SYSCLK_HZ / 1)
+#define PCLK1_HZ      (HCLK_HZ / 2)       // APB1: USART2/3, I2C1
+#define PCLK2_HZ      (HCLK_HZ / 1)       // APB2: USART1, SPI1, ADC1
+
+/* USART, 16x oversampling: BRR = PCLK / baud, error in 0.1 % steps */
+#define USART_BRR(pclk, baud)   (((pclk) + (baud) / 2) / (baud))
+#define USART_REAL(pclk, baud)  ((pclk) / USART_BRR(pclk, baud))
+#define USART_ERR(pclk, baud)                                   \
+    ((USART_REAL(pclk, baud) > (baud) ?                         \
+      USART_REAL(pclk, baud) - (baud) :                         \
+      (baud) - USART_REAL(pclk, baud)) * 1000 / (baud))
+#define USART_CHECK(pclk, baud, name)                           \
+    _Static_assert(USART_BRR(pclk, baud) >= 16 &&               \
+                   USART_ERR(pclk, baud) <= 20,                 \
+                   name " baud rate out of tolerance")
+
+/* SPI1: smallest BR (fPCLK2 / 2^(BR+1)) keeping SCK <= SPI_MAX_HZ */
+#define SPI_MAX_HZ    10000000UL          // nRF24L01 SCK limit
+#define SPI_FITS(br)  ((PCLK2_HZ >> ((br) + 1)) <= SPI_MAX_HZ)
+#define SPI_BR_BITS   (SPI_FITS(0) ? 0 : SPI_FITS(1) ? 1 :      \
+                       SPI_FITS(2) ? 2 : SPI_FITS(3) ? 3 :      \
+                       SPI_FITS(4) ? 4 : SPI_FITS(5) ? 5 :      \
+                       SPI_FITS(6) ? 6 : 7)
+_Static_assert(SPI_FITS(SPI_BR_BITS), "SPI1 clock above SPI_MAX_HZ");
+
+#define DEBUG_BAUD    9600
+USART_CHECK(PCLK1_HZ, DEBUG_BAUD, "USART2");
+
+/* ================= DEFERRED LOG ================= */
+/* LOG("fmt", args...) sends a string ID and raw args, never the text:
+     0xA0 | nargs    1 byte (nargs 0..4)
+     id              2 bytes LE, offset of the string in LOGSTR
+     args            4 bytes LE each
+   Format strings are local objects s_ in section .logstr. main.sct
+   gives it its own load region LOGSTR outside flash, so the text is
+   only in Objects/main.axf, where log_decode.py reads it back. The
+   strings are never read on the target. LOGSTR is capped at 64 KB,
+   so armlink fails (L6220E) before an offset can outgrow 16 bits. */
+#define LOG_STR(fmt)                                                \
+    ({ static const char s_[]                                       \
+           __attribute__((section(".logstr"), used)) = fmt; s_; })
+#define LOG_NARGS(...)              LOG_NARGS_(0, ##__VA_ARGS__, 4, 3, 2, 1, 0)
+#define LOG_NARGS_(z, a, b, c, d, n, ...)  n
+#define LOG(fmt, ...)                                               \
+    log_emit(LOG_STR(fmt), LOG_NARGS(__VA_ARGS__), ##__VA_ARGS__)
+
+extern const char Image$$LOGSTR$$Base[];    // armlink, from main.sct
+
 /* ================= nRF24L01 ================= */
 #define NRF_CMD_R_REGISTER   0x00
 #define NRF_REG_STATUS       0x07
@@ -36,11 +90,26 @@ void uart2_send_string(const char *s)
     while (*s) uart2_send_char(*s++);
 }
 
-void uart2_send_hex(uint8_t v)
+/* ================= DEFERRED LOG ================= */
+void log_emit(const char *fmt, int nargs, ...)
 {
-    const char map[] = "0123456789ABCDEF";
-    uart2_send_char(map[(v >> 4) & 0x0F]);
-    uart2_send_char(map[v & 0x0F]);
+    uint32_t id = fmt - Image$$LOGSTR$$Base;
+    va_list ap;
+
+    uart2_send_char(0xA0 | nargs);
+    uart2_send_char(id);
+    uart2_send_char(id >> 8);
+
+    va_start(ap, nargs);
+    while (nargs--)
+    {
+        uint32_t v = va_arg(ap, uint32_t);
+        uart2_send_char(v);
+        uart2_send_char(v >> 8);
+        uart2_send_char(v >> 16);
+        uart2_send_char(v >> 24);
+    }
+    va_end(ap);
 }
 
 /* ================= SPI TRANSFER ================= */
@@ -64,7 +133,7 @@ int main(void)
     GPIOA_CRL |=  (0xB << 8);   // PA2 TX
     GPIOA_CRL |=  (0x4 << 12);  // PA3 RX
 
-    USART2_BRR = 0x0EA6;        // 9600 baud
+    USART2_BRR = USART_BRR(PCLK1_HZ, DEBUG_BAUD);
     USART2_CR1 = (1 << 13) | (1 << 3) | (1 << 2);
 
     /* ================= SPI1 PINS ================= */
@@ -86,33 +155,33 @@ int main(void)
         (1 << 2) |    // Master
         (1 << 9) |    // SSM
         (1 << 8) |    // SSI
-        (3 << 3);     // Baud rate = fPCLK/16
+        (SPI_BR_BITS << 3);   // Baud rate = fastest <= SPI_MAX_HZ
 
     SPI1_CR1 |= (1 << 6);       // SPI Enable
 
     /* ================= WELCOME MESSAGE ================= */
-    uart2_send_string("\r\nWelcome to SPI Communication\r\n");
-    uart2_send_string("Theme of Project is Interfacing SPI Protocol\r\n\r\n");
+    LOG("\r\nWelcome to SPI Communication\r\n");
+    LOG("Theme of Project is Interfacing SPI Protocol\r\n\r\n");
 
-    uart2_send_string("Heading : SPI Register Read Test\r\n");
-    uart2_send_string("Master  : STM32F103C8T6\r\n");
-    uart2_send_string("Slave   : nRF24L01 (SPI Device)\r\n\r\n");
+    LOG("Heading : SPI Register Read Test\r\n");
+    LOG("Master  : STM32F103C8T6\r\n");
+    LOG("Slave   : nRF24L01 (SPI Device)\r\n\r\n");
 
-    uart2_send_string("SPI Pin Configuration:\r\n");
-    uart2_send_string("SCK  -> PA5\r\n");
-    uart2_send_string("MOSI -> PA7\r\n");
-    uart2_send_string("MISO -> PA6\r\n");
-    uart2_send_string("CSN  -> PB12\r\n");
-    uart2_send_string("CE   -> PB13 (Held LOW)\r\n\r\n");
+    LOG("SPI Pin Configuration:\r\n");
+    LOG("SCK  -> PA5\r\n");
+    LOG("MOSI -> PA7\r\n");
+    LOG("MISO -> PA6\r\n");
+    LOG("CSN  -> PB12\r\n");
+    LOG("CE   -> PB13 (Held LOW)\r\n\r\n");
 
-    uart2_send_string("SPI Mode : Master\r\n");
-    uart2_send_string("CPOL/CPHA: Mode 0 (0,0)\r\n");
-    uart2_send_string("Data Size: 8-bit\r\n");
-    uart2_send_string("Clock    : fPCLK / 16\r\n\r\n");
+    LOG("SPI Mode : Master\r\n");
+    LOG("CPOL/CPHA: Mode 0 (0,0)\r\n");
+    LOG("Data Size: 8-bit\r\n");
+    LOG("Clock    : fPCLK / %u\r\n\r\n", 2u << SPI_BR_BITS);
 
-    uart2_send_string("Operation:\r\n");
-    uart2_send_string("Reading STATUS register (0x07) from nRF24L01\r\n");
-    uart2_send_string("Using SPI full-duplex communication\r\n\r\n");
+    LOG("Operation:\r\n");
+    LOG("Reading STATUS register (0x07) from nRF24L01\r\n");
+    LOG("Using SPI full-duplex communication\r\n\r\n");
 
     /* ================= READ STATUS REGISTER ================= */
     GPIOB_ODR &= ~(1 << 12);    // CSN LOW
@@ -123,9 +192,8 @@ int main(void)
 
     GPIOB_ODR |= (1 << 12);     // CSN HIGH
 
-    uart2_send_string("STATUS Register: 0x");
-    uart2_send_hex(status);
-    uart2_send_string("\r\nSPI Communication OK\r\n");
+    LOG("STATUS Register: 0x%02X\r\n", status);
+    LOG("SPI Communication OK\r\n");
 
     while (1);
 }
@@ -1,4 +1,9 @@
 #include <stdint.h>
+#include "ring.h"
+
+/* rx_stress.c builds this file on a PC: it defines HOST_SIM and
+   maps every register below onto a simulated USART2 */
+#ifndef HOST_SIM
 
 /* ================= RCC ================= */
 #define RCC_APB2ENR   (*(volatile uint32_t*)0x40021018)
@@ -16,13 +21,52 @@
 /* ================= NVIC ================= */
 #define NVIC_ISER1    (*(volatile uint32_t*)0xE000E104)
 
+/* ================= BARRIER ================= */
+/* Data memory barrier: slot contents before index, index before reuse */
+#define DMB()         __asm volatile ("dmb" ::: "memory")
+
+#endif /* HOST_SIM */
+
+/* ================= CLOCK TREE ================= */
+/* Same selection as SetSysClockTo72() in system_stm32f10x.c:
+   HSE 8 MHz x PLL 9 = SYSCLK 72 MHz, AHB /1, APB1 /2, APB2 /1 */
+#define HSE_HZ        8000000UL
+#define SYSCLK_HZ     (HSE_HZ * 9)
+#define HCLK_HZ       (SYSCLK_HZ / 1)
+#define PCLK1_HZ      (HCLK_HZ / 2)       // APB1: USART2/3, I2C1
+#define PCLK2_HZ      (HCLK_HZ / 1)       // APB2: USART1, SPI1, ADC1
+
+/* USART, 16x oversampling: BRR = PCLK / baud, error in 0.1 % steps */
+#define USART_BRR(pclk, baud)   (((pclk) + (baud) / 2) / (baud))
+#define USART_REAL(pclk, baud)  ((pclk) / USART_BRR(pclk, baud))
+#define USART_ERR(pclk, baud)                                   \
+    ((USART_REAL(pclk, baud) > (baud) ?                         \
+      USART_REAL(pclk, baud) - (baud) :                         \
+      (baud) - USART_REAL(pclk, baud)) * 1000 / (baud))
+#define USART_CHECK(pclk, baud, name)                           \
+    _Static_assert(USART_BRR(pclk, baud) >= 16 &&               \
+                   USART_ERR(pclk, baud) <= 20,                 \
+                   name " baud rate out of tolerance")
+
+#define DEBUG_BAUD    9600
+USART_CHECK(PCLK1_HZ, DEBUG_BAUD, "USART2");
+
 /* ================= DEFINES ================= */
-#define RX_BUF_SIZE  64
+#define RX_BUF_SIZE  64             // bytes per line (incl. '\0')
+#define RX_LINES     8              // line slots, power of two
 
 /* ================= GLOBALS ================= */
-volatile char rx_buffer[RX_BUF_SIZE];
-volatile uint8_t rx_index = 0;
-volatile uint8_t line_ready = 0;
+/* Single-producer (ISR) / single-consumer (main) ring of lines.
+   rx_wr is only written by the ISR, rx_rd only by main.
+   Both are free-running, see ring.h. */
+volatile char    rx_lines[RX_LINES][RX_BUF_SIZE];
+volatile uint8_t rx_wr = 0;         // lines published by ISR
+volatile uint8_t rx_rd = 0;         // lines released by main
+volatile uint32_t rx_lost = 0;      // lines dropped, ring was full
+RING_CHECK(uint8_t, RX_LINES, "RX line");
+
+uint8_t rx_index = 0;               // ISR only: write position in line
+uint8_t rx_discard = 0;             // ISR only: dropping current line
 
 /* ================= UART SEND ================= */
 void uart2_send_char(char c)
@@ -43,25 +87,39 @@ void USART2_IRQHandler(void)
     if (USART2_SR & (1 << 5))   // RXNE
     {
         char ch = USART2_DR;
+        uint8_t wr = rx_wr;
+
+        /* Ring full: never wait, drop this line instead */
+        if (RING_FULL(uint8_t, wr, rx_rd, RX_LINES))
+            rx_discard = 1;
 
         if (ch == '\r')   // ENTER pressed
         {
-            rx_buffer[rx_index] = '\0';   // Null terminate
-            line_ready = 1;
+            if (rx_discard)
+            {
+                rx_lost++;
+            }
+            else
+            {
+                rx_lines[RING_SLOT(wr, RX_LINES)][rx_index] = '\0';
+                DMB();                  // line text visible first
+                rx_wr = wr + 1;         // then publish the slot
+            }
             rx_index = 0;
+            rx_discard = 0;
         }
-        else
+        else if (!rx_discard)
         {
             if (rx_index < RX_BUF_SIZE - 1)
             {
-                rx_buffer[rx_index++] = ch;
+                rx_lines[RING_SLOT(wr, RX_LINES)][rx_index++] = ch;
             }
         }
     }
 }
 
-/* ================= MAIN ================= */
-int main(void)
+/* ================= INIT ================= */
+void uart2_init(void)
 {
     /* Enable clocks */
     RCC_APB2ENR |= (1 << 2);     // GPIOA
@@ -72,8 +130,8 @@ int main(void)
     GPIOA_CRL |=  (0xB << 8);    // PA2 AF PP
     GPIOA_CRL |=  (0x4 << 12);   // PA3 input floating
 
-    /* Baud rate 9600 (PCLK1 = 36MHz) */
-    USART2_BRR = 0x0EA6;
+    /* Baud rate DEBUG_BAUD (PCLK1 = 36MHz) */
+    USART2_BRR = USART_BRR(PCLK1_HZ, DEBUG_BAUD);
 
     /* USART2 config
        UE, TE, RE
@@ -91,6 +149,36 @@ int main(void)
 
     /* Enable USART2 IRQ */
     NVIC_ISER1 |= (1 << 6);
+}
+
+/* ================= LINE CONSUMER ================= */
+/* Drain every line received since the last pass */
+void rx_drain(void)
+{
+    while (!RING_EMPTY(rx_wr, rx_rd))
+    {
+        const char *line;
+
+        DMB();                      // see slot text after rx_wr
+        line = (const char *)rx_lines[RING_SLOT(rx_rd, RX_LINES)];
+
+        uart2_send_string("From Keyboard : ");
+        uart2_send_string(line);
+        uart2_send_string("\r\n");
+
+        uart2_send_string("To   Teraterm : ");
+        uart2_send_string(line);
+        uart2_send_string("\r\n\r\n");
+
+        DMB();                      // finish reading before release
+        rx_rd++;
+    }
+}
+
+/* ================= MAIN ================= */
+int main(void)
+{
+    uart2_init();
 
     /* Welcome message */
     uart2_send_string("\r\nWelcome to UART Communication:\r\n");
@@ -102,17 +190,6 @@ int main(void)
 
     while (1)
     {
-        if (line_ready)
-        {
-            uart2_send_string("From Keyboard : ");
-            uart2_send_string((char *)rx_buffer);
-            uart2_send_string("\r\n");
-
-            uart2_send_string("To   Teraterm : ");
-            uart2_send_string((char *)rx_buffer);
-            uart2_send_string("\r\n\r\n");
-
-            line_ready = 0;
-        }
+        rx_drain();
     }
 }
@@ -0,0 +1,281 @@
+/* ================= HOST STRESS TEST: USART2 RX LINES ================= */
+/* Not part of the Keil project. Builds main.c on a PC (HOST_SIM maps
+   the registers onto the model below) and runs the real
+   USART2_IRQHandler and rx_drain() against a simulated USART2:
+
+     gcc -O2 -Wall rx_stress.c -o rx_stress && ./rx_stress
+
+   Time is counted in HCLK cycles. RX bytes arrive at the character
+   time main.c programs (start + 9 data/parity + stop bits at BRR),
+   each one raises RXNE and runs the ISR. The consumer is the real
+   rx_drain(): it echoes every line twice at the same baud, so it is
+   more than twice as slow as the sender. Each TXE poll in
+   uart2_send_char lets the line time run on to the next event.
+   Not modelled: overrun (the ISR is never late here), framing and
+   parity errors.
+
+   Every line the sender typed must come out intact (truncated to
+   RX_BUF_SIZE - 1), in order, or be counted in rx_lost:
+     burst  RX_LINES lines back to back, then a pause: zero loss
+     flood  lines back to back: echoed + rx_lost = sent, and the
+            RX_LINES lines after the final pause all come out
+   Lines are 0..90 printable chars (some beyond RX_BUF_SIZE) ending
+   in '\r', and rx_wr / rx_rd wrap many times. */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define LINES_MAX     4000
+#define LINE_LEN_MAX  90
+#define CYC_ISR       60                  // RX ISR, entry and exit
+#define CYC_POLL      8                   // one TXE poll
+
+/* ================= SIMULATED REGISTERS ================= */
+struct
+{
+    volatile uint32_t RCC_APB2ENR, RCC_APB1ENR;
+    volatile uint32_t GPIOA_CRL;
+    volatile uint32_t USART2_SR, USART2_BRR, USART2_CR1;
+    volatile uint32_t NVIC_ISER1;
+} sim;
+
+volatile uint32_t *sim_sr(void);
+volatile uint32_t *sim_dr(void);
+
+#define RCC_APB2ENR   sim.RCC_APB2ENR
+#define RCC_APB1ENR   sim.RCC_APB1ENR
+#define GPIOA_CRL     sim.GPIOA_CRL
+#define USART2_SR     (*sim_sr())
+#define USART2_DR     (*sim_dr())
+#define USART2_BRR    sim.USART2_BRR
+#define USART2_CR1    sim.USART2_CR1
+#define NVIC_ISER1    sim.NVIC_ISER1
+#define DMB()         __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+/* ================= FIRMWARE ================= */
+#define HOST_SIM
+#define main firmware_main
+#include "main.c"
+#undef main
+
+/* ================= USART2 MODEL ================= */
+/* DR is both ways, so it is a cell: a value with SIM_MARK in its top
+   byte is the RX byte the ISR reads, anything else is a byte main
+   wrote, collected on the next SR or DR access. */
+#define SIM_MARK      0x5A000000u
+
+uint64_t sim_now;
+uint64_t sim_char_cyc;                  // one character on the line
+uint64_t sim_tx_free;                   // TX line idle from here
+int      sim_in_isr;
+
+volatile uint32_t sim_cell = SIM_MARK;
+volatile uint32_t sim_sr_val;
+
+const uint8_t *sim_rx;                  // bytes the sender types
+const uint64_t *sim_rx_at;              // and when each one ends
+uint32_t       sim_rx_len, sim_rx_pos;
+
+static char     tx_out[LINES_MAX * (2 * LINE_LEN_MAX + 40)];
+static uint32_t tx_len;
+
+static void sim_collect(void)
+{
+    uint32_t v = sim_cell;
+
+    if ((v & 0xFF000000u) == SIM_MARK)
+        return;
+
+    if (tx_len < sizeof(tx_out))
+        tx_out[tx_len++] = (char)v;
+    sim_tx_free = (sim_tx_free > sim_now ? sim_tx_free : sim_now) + sim_char_cyc;
+    sim_cell = SIM_MARK;
+}
+
+/* Deliver every RX byte that has arrived by cycle t */
+static void sim_run(uint64_t t)
+{
+    while (sim_rx_pos < sim_rx_len && sim_rx_at[sim_rx_pos] <= t)
+    {
+        if (sim_now < sim_rx_at[sim_rx_pos])
+            sim_now = sim_rx_at[sim_rx_pos];
+
+        sim_collect();
+        sim_cell = SIM_MARK | sim_rx[sim_rx_pos++];
+        sim_in_isr = 1;
+        USART2_IRQHandler();
+        sim_in_isr = 0;
+        sim_collect();
+        sim_cell = SIM_MARK;
+        sim_now += CYC_ISR;
+    }
+    if (sim_now < t)
+        sim_now = t;
+}
+
+volatile uint32_t *sim_sr(void)
+{
+    sim_collect();
+
+    /* main spins on TXE: let time run to the next event */
+    if (!sim_in_isr)
+        sim_run(sim_tx_free > sim_now ? sim_tx_free : sim_now + CYC_POLL);
+
+    sim_sr_val = (sim_tx_free <= sim_now ? (1 << 7) | (1 << 6) : 0) |
+                 (sim_in_isr ? (1 << 5) : 0);
+    return &sim_sr_val;
+}
+
+volatile uint32_t *sim_dr(void)
+{
+    sim_collect();
+    return &sim_cell;
+}
+
+/* ================= WORKLOADS ================= */
+static uint8_t  stream[LINES_MAX * (LINE_LEN_MAX + 1)];
+static uint64_t stream_at[sizeof(stream)];
+static uint16_t line_len[LINES_MAX];
+static uint32_t line_at[LINES_MAX];     // offset in stream
+static uint32_t rng = 2463534242u;
+static int      fails;
+
+static uint32_t xorshift32(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+#define FAIL(...)                                               \
+    do {                                                        \
+        if (fails++ < 10)                                       \
+            printf("FAIL " __VA_ARGS__);                        \
+    } while (0)
+
+/* Send n lines, a pause of 'pause' characters after every 'burst' */
+static void run(const char *name, uint32_t n, uint32_t burst, uint32_t pause)
+{
+    const char *p, *end;
+    uint32_t len = 0, next = 0, echoed = 0, skipped = 0, last = 0;
+    uint64_t t = 0;
+
+    /* Sender: random lines at full line rate */
+    for (uint32_t i = 0; i < n; i++)
+    {
+        line_at[i]  = len;
+        line_len[i] = xorshift32() % (LINE_LEN_MAX + 1);
+        for (uint32_t k = 0; k <= line_len[i]; k++)
+        {
+            stream[len] = k < line_len[i] ? ' ' + xorshift32() % 95 : '\r';
+            t += sim_char_cyc;
+            stream_at[len++] = t;
+        }
+        if ((i + 1) % burst == 0)
+            t += pause * sim_char_cyc;
+    }
+
+    /* Reset the firmware's ring just below the index wrap */
+    rx_wr = rx_rd = (uint8_t)-3;
+    rx_lost = rx_index = rx_discard = 0;
+    sim_rx = stream;
+    sim_rx_at = stream_at;
+    sim_rx_len = len;
+    sim_rx_pos = 0;
+    sim_now = sim_tx_free = 0;
+    tx_len = 0;
+
+    /* main(): drain, and while idle wait for the next byte */
+    while (sim_rx_pos < sim_rx_len || !RING_EMPTY(rx_wr, rx_rd))
+    {
+        if (RING_EMPTY(rx_wr, rx_rd))
+            sim_run(sim_rx_at[sim_rx_pos]);
+        rx_drain();
+    }
+    sim_collect();
+
+    /* Every echo must be a sent line, in order, printed twice */
+    p = tx_out;
+    end = tx_out + tx_len;
+    while (p < end)
+    {
+        const char *a, *b;
+        size_t la, lb;
+
+        if (strncmp(p, "From Keyboard : ", 16) != 0 ||
+            !(a = p + 16, b = memchr(a, '\r', end - a)))
+        {
+            FAIL("%s: bad echo at byte %u\n", name, (unsigned)(p - tx_out));
+            break;
+        }
+        la = b - a;
+        p = b + 2;
+        if (strncmp(p, "To   Teraterm : ", 16) != 0 ||
+            !(b = memchr(p + 16, '\r', end - p - 16)) ||
+            (lb = b - (p + 16)) != la || memcmp(a, p + 16, la) != 0 ||
+            strncmp(b, "\r\n\r\n", 4) != 0)
+        {
+            FAIL("%s: echo %u differs from its first copy\n", name,
+                 (unsigned)echoed);
+            break;
+        }
+        p = b + 4;
+
+        /* Lines not echoed before this one were dropped */
+        while (next < n)
+        {
+            uint32_t l = line_len[next] < RX_BUF_SIZE - 1 ?
+                         line_len[next] : RX_BUF_SIZE - 1;
+
+            if (l == la && memcmp(stream + line_at[next], a, la) == 0)
+                break;
+            next++;
+            skipped++;
+        }
+        if (next == n)
+        {
+            FAIL("%s: echo %u is no line that was sent\n", name,
+                 (unsigned)echoed);
+            break;
+        }
+        last += next >= n - RX_LINES;
+        next++;
+        echoed++;
+    }
+    skipped += n - next;
+
+    printf("%-6s %5u lines %7u B in %6.1f s: echoed %5u, rx_lost %5u, "
+           "missing %5u\n", name, (unsigned)n, (unsigned)len,
+           (double)t / HCLK_HZ, (unsigned)echoed, (unsigned)rx_lost,
+           (unsigned)skipped);
+
+    if (skipped != rx_lost)
+        FAIL("%s: %u lines missing but rx_lost is %u\n", name,
+             (unsigned)skipped, (unsigned)rx_lost);
+    if (burst <= RX_LINES && rx_lost)
+        FAIL("%s: lines lost although the ring had room\n", name);
+    if (last != RX_LINES)
+        FAIL("%s: %u of the last %u lines echoed\n", name,
+             (unsigned)last, RX_LINES);
+}
+
+/* ================= MAIN ================= */
+int main(void)
+{
+    uart2_init();
+    sim_char_cyc = (USART2_CR1 & (1 << 12) ? 11 : 10) *
+                   (uint64_t)USART2_BRR * (HCLK_HZ / PCLK1_HZ);
+    printf("USART2 %u baud, %u bits/char: %.0f chars/s each way\n",
+           DEBUG_BAUD, (USART2_CR1 & (1 << 12)) ? 11 : 10,
+           (double)HCLK_HZ / sim_char_cyc);
+
+    /* RX_LINES back to back fill the ring exactly; the pause lets
+       the echo of all of them (2 * 90 + 38 chars each) finish */
+    run("burst", 2000, RX_LINES, RX_LINES * (2 * LINE_LEN_MAX + 40));
+    run("flood", LINES_MAX, LINES_MAX - RX_LINES,
+        RX_LINES * (2 * LINE_LEN_MAX + 40));
+
+    printf("%s (%d failures)\n", fails ? "FAILED" : "OK", fails);
+    return fails != 0;
+}
@@ -0,0 +1,444 @@
+import heapq
+import os
+import random
+import select
+import socket
+import sys
+import time
+import tty
+
+# Stands in for the ESP32 / ESP8266 AT firmware on USART3, so the ESP
+# projects can be run without the module:
+#
+#   python3 esp_at_emulator.py                        (creates a pty)
+#   python3 esp_at_emulator.py --port /dev/ttyUSB0    (USB-UART wired to
+#                                                      the STM32 USART3)
+#
+# esp_at_shim.c builds a project's main.c for the PC and runs it on the
+# pty printed at start, so the firmware's AT engine can be tested here.
+#
+# Options:
+#   --latency MS      delay before every response            (5)
+#   --join MS         time AT+CWJAP takes                    (1500)
+#   --inject PATHS    after AT+CIPSERVER, a client connects and sends
+#                     "GET <path>" for each comma separated path
+#   --every S         seconds between injected requests      (1)
+#   --links N         injected requests rotate over N links  (1)
+#   --drop S          close every link S seconds after it opens
+#   --garbage P       probability of a junk line before a response
+#   --outage S,D      every S seconds the AP goes away for D seconds:
+#                     WIFI DISCONNECT, links closed, CWJAP / CIPSTART fail
+#   --forward         CIPSTART opens a real TCP/UDP socket, CIPSEND data
+#                     goes to it and its replies come back as +IPD
+#                     (server.py, udp_receiver.py, mqtt_broker.py)
+#   --baud N          serial speed for --port               (115200)
+#
+# Reported on exit (Ctrl-C) and every 10 s:
+#   boot->ready  "ready" sent to the first CIPSERVER/CIPSTART OK
+#   request RTT  injected +IPD to SEND OK of the answer on that link
+#   CIPSEND      count and payload throughput
+
+REPORT_S = 10
+
+
+class Emulator:
+    def __init__(self, opts):
+        self.o = opts
+        self.t0 = time.monotonic()
+        self.events = []               # (time, seq, fn)
+        self.seq = 0
+        self.out_t = 0.0               # keeps responses in order
+        self.rx = b""
+        self.mode = "cmd"              # cmd | data | passthru
+        self.need = 0                  # CIPSEND bytes still expected
+        self.send_link = 0
+        self.send_data = b""
+        self.echo = True
+        self.mux = 0
+        self.cipmode = 0
+        self.server = False
+        self.links = {}                # id -> socket or None
+        self.inject_n = 0
+        self.pending = {}              # link -> injected request time
+        self.boot_t = None
+        self.ready_t = None
+        self.rtt = []
+        self.sends = 0
+        self.send_bytes = 0
+        self.last_rx = 0.0
+        self.plus = 0.0                # time "+++" arrived alone
+        self.ap_down = False           # --outage in progress
+        self.joined = False
+
+    # ---------- timing ----------
+    def now(self):
+        return time.monotonic() - self.t0
+
+    def at(self, delay, fn):
+        self.seq += 1
+        heapq.heappush(self.events, (self.now() + delay, self.seq, fn))
+
+    def reply(self, text, delay=None):
+        # Responses leave in order, each after the configured latency
+        t = max(self.now() + (self.o["latency"] if delay is None else delay),
+                self.out_t)
+        self.out_t = t
+        data = text.encode("latin-1") if isinstance(text, str) else text
+        if self.o["garbage"] and random.random() < self.o["garbage"]:
+            junk = bytes(random.randrange(1, 256) for _ in range(random.randrange(1, 12)))
+            data = b"\r\n" + junk.replace(b"\n", b"?") + b"\r\n" + data
+        self.seq += 1
+        heapq.heappush(self.events, (t, self.seq, lambda: self.write(data)))
+
+    def write(self, data):
+        os.write(self.fd, data)
+
+    # ---------- boot ----------
+    def boot(self):
+        # ROM boot banner at 74880 baud looks like noise at 115200
+        self.write(bytes(random.randrange(0x80, 0x100) for _ in range(24)))
+        self.reply("\r\nready\r\n", delay=0.3)
+        self.at(0.3, self.mark_boot)
+
+    def mark_boot(self):
+        self.boot_t = self.now()
+        print("[emu] ready sent")
+
+    def mark_ready(self):
+        if self.ready_t is None and self.boot_t is not None:
+            self.ready_t = self.out_t          # when that OK goes out
+            print("[emu] boot->ready %.1f ms" % ((self.ready_t - self.boot_t) * 1000))
+
+    # ---------- links ----------
+    def link_open(self, lid, sock):
+        self.links[lid] = sock
+        if self.o["drop"]:
+            self.at(self.o["drop"], lambda: self.link_drop(lid))
+
+    def link_drop(self, lid):
+        if lid not in self.links:
+            return
+        sock = self.links.pop(lid)
+        if sock:
+            sock.close()
+        self.pending.pop(lid, None)
+        if self.mode == "passthru":
+            self.mode = "cmd"          # real firmware stays; good enough
+        self.reply("%sCLOSED\r\n" % ("%d," % lid if self.mux else ""))
+
+    def outage(self):
+        every, length = self.o["outage"]
+        self.ap_down = True
+        print("[emu] AP down for %.0f s" % length)
+        for lid in list(self.links):
+            self.link_drop(lid)
+        if self.joined:
+            self.joined = False
+            self.reply("WIFI DISCONNECT\r\n")
+        self.at(length, self.ap_back)
+        self.at(every, self.outage)
+
+    def ap_back(self):
+        self.ap_down = False
+        print("[emu] AP back")
+
+    def ipd(self, lid, payload):
+        head = "+IPD,%d,%d:" % (lid, len(payload)) if self.mux else "+IPD,%d:" % len(payload)
+        self.reply(b"\r\n" + head.encode() + payload)
+
+    def inject(self):
+        paths = self.o["inject"]
+        path = paths[self.inject_n % len(paths)]
+        lid = self.inject_n % self.o["links"]
+        self.inject_n += 1
+
+        if lid not in self.links:
+            self.link_open(lid, None)
+            self.reply("%d,CONNECT\r\n" % lid)
+        req = ("GET %s HTTP/1.1\r\nHost: 192.168.1.50\r\n"
+               "User-Agent: esp_at_emulator\r\n\r\n" % path).encode()
+        self.ipd(lid, req)
+        self.pending.setdefault(lid, self.out_t)
+        self.at(self.o["every"], self.inject)
+
+    # ---------- commands ----------
+    def command(self, line):
+        if self.echo:
+            self.reply(line + "\r\n", delay=0)
+        cmd, _, arg = line.partition("=")
+        args = [a.strip('"') for a in arg.split(",")] if arg else []
+
+        if cmd in ("AT", "AT+CWMODE", "AT+GMR", "AT+CWQAP"):
+            self.reply("\r\nOK\r\n")
+        elif cmd == "ATE0":
+            self.echo = False
+            self.reply("\r\nOK\r\n")
+        elif cmd == "ATE1":
+            self.echo = True
+            self.reply("\r\nOK\r\n")
+        elif cmd == "AT+RST":
+            self.reply("\r\nOK\r\n")
+            self.links.clear()
+            self.joined = False
+            self.at(self.o["latency"] + 0.01, self.boot)
+        elif cmd == "AT+UART_CUR":
+            self.reply("\r\nOK\r\n")
+            if self.o["port"]:
+                self.at(self.o["latency"] + 0.01, lambda: self.set_baud(int(args[0])))
+        elif cmd == "AT+CWJAP":
+            if self.ap_down:
+                self.reply("+CWJAP:3\r\n", delay=self.o["join"])
+                self.reply("\r\nFAIL\r\n")
+                return
+            self.joined = True
+            self.reply("WIFI CONNECTED\r\n", delay=self.o["join"] * 0.7)
+            self.reply("WIFI GOT IP\r\n", delay=self.o["join"])
+            self.reply("\r\nOK\r\n")
+        elif cmd == "AT+CIFSR":
+            self.reply('+CIFSR:STAIP,"192.168.1.50"\r\n'
+                       '+CIFSR:STAMAC,"24:0a:c4:00:00:01"\r\n\r\nOK\r\n')
+        elif cmd == "AT+CIPMUX":
+            self.mux = int(args[0])
+            self.reply("\r\nOK\r\n")
+        elif cmd == "AT+CIPMODE":
+            self.cipmode = int(args[0])
+            self.reply("\r\nOK\r\n")
+        elif cmd == "AT+CIPSERVER":
+            self.server = args[0] == "1"
+            self.reply("\r\nOK\r\n")
+            self.mark_ready()
+            if self.server and self.o["inject"]:
+                self.at(self.o["every"], self.inject)
+        elif cmd == "AT+CIPSTART":
+            self.cipstart(args)
+        elif cmd == "AT+CIPSEND":
+            self.cipsend(args)
+        elif cmd == "AT+CIPCLOSE":
+            lid = int(args[0]) if args else 0
+            if lid in self.links:
+                self.link_drop(lid)
+                self.reply("\r\nOK\r\n")
+            else:
+                self.reply("\r\nERROR\r\n")
+        else:
+            self.reply("\r\nERROR\r\n")
+
+    def cipstart(self, args):
+        lid = int(args[0]) if self.mux else 0
+        if self.mux:
+            args = args[1:]
+        if lid in self.links:
+            self.reply("ALREADY CONNECTED\r\n\r\nERROR\r\n")
+            return
+        if self.ap_down or not self.joined:
+            self.reply("\r\nERROR\r\nCLOSED\r\n")
+            return
+
+        sock = None
+        if self.o["forward"]:
+            try:
+                kind = socket.SOCK_DGRAM if args[0] == "UDP" else socket.SOCK_STREAM
+                sock = socket.socket(socket.AF_INET, kind)
+                sock.settimeout(2)
+                sock.connect((args[1], int(args[2])))
+                sock.setblocking(False)
+            except (OSError, IndexError, ValueError) as e:
+                print("[emu] CIPSTART failed:", e)
+                self.reply("\r\nERROR\r\nCLOSED\r\n")
+                return
+
+        self.link_open(lid, sock)
+        self.reply("%sCONNECT\r\n\r\nOK\r\n" % ("%d," % lid if self.mux else ""))
+        self.mark_ready()
+
+    def cipsend(self, args):
+        if not args:
+            if not self.cipmode or 0 not in self.links:
+                self.reply("\r\nERROR\r\n")
+                return
+            self.mode = "passthru"
+            self.reply("\r\nOK\r\n\r\n>")
+            return
+
+        lid = int(args[0]) if self.mux else 0
+        n = int(args[-1])
+        if lid not in self.links or not 0 < n <= 2048:
+            self.reply("link is not valid\r\n\r\nERROR\r\n")
+            return
+        self.send_link, self.need, self.send_data = lid, n, b""
+        self.mode = "data"
+        self.reply("\r\nOK\r\n> ")
+
+    def sent(self):
+        lid, data = self.send_link, self.send_data
+        self.sends += 1
+        self.send_bytes += len(data)
+        self.reply("\r\nRecv %d bytes\r\n\r\nSEND OK\r\n" % len(data))
+        sock = self.links.get(lid)
+        if sock:
+            try:
+                sock.send(data)
+            except OSError:
+                self.link_drop(lid)
+        if lid in self.pending:
+            self.rtt.append(self.out_t - self.pending.pop(lid))
+
+    # ---------- input ----------
+    def feed(self, data):
+        now = self.now()
+        if self.mode == "passthru":
+            if data == b"+++" and now - self.last_rx >= 0.9:
+                self.plus = now
+            else:
+                self.plus = 0.0
+                sock = self.links.get(0)
+                if sock:
+                    sock.send(data)
+                self.send_bytes += len(data)
+            self.last_rx = now
+            return
+        self.last_rx = now
+
+        self.rx += data
+        while self.rx:
+            if self.mode == "data":
+                take = self.rx[:self.need]
+                self.rx = self.rx[len(take):]
+                self.send_data += take
+                self.need -= len(take)
+                if self.need == 0:
+                    self.mode = "cmd"
+                    self.sent()
+                continue
+            if b"\n" not in self.rx:
+                break
+            line, _, self.rx = self.rx.partition(b"\n")
+            line = line.strip(b"\r").decode("latin-1")
+            if line.startswith("AT"):
+                self.command(line)
+
+    def poll_links(self):
+        for lid, sock in list(self.links.items()):
+            if not sock:
+                continue
+            try:
+                data = sock.recv(1460)
+            except BlockingIOError:
+                continue
+            except OSError:
+                data = b""
+            if not data:
+                self.link_drop(lid)
+            elif self.mode == "passthru":
+                self.write(data)
+            else:
+                self.ipd(lid, data)
+
+    def set_baud(self, baud):
+        import termios
+        attrs = termios.tcgetattr(self.fd)
+        speed = getattr(termios, "B%d" % baud)
+        attrs[4] = attrs[5] = speed
+        termios.tcsetattr(self.fd, termios.TCSADRAIN, attrs)
+        print("[emu] baud", baud)
+
+    def report(self):
+        if self.ready_t is not None:
+            print("[emu] boot->ready %.1f ms" % ((self.ready_t - self.boot_t) * 1000))
+        if self.rtt:
+            ms = sorted(r * 1000 for r in self.rtt)
+            print("[emu] request RTT n=%d min %.1f avg %.1f p95 %.1f max %.1f ms"
+                  % (len(ms), ms[0], sum(ms) / len(ms),
+                     ms[min(len(ms) - 1, int(len(ms) * 0.95))], ms[-1]))
+        t = self.now() - (self.boot_t or 0)
+        print("[emu] CIPSEND %d, %d payload bytes, %.0f B/s"
+              % (self.sends, self.send_bytes, self.send_bytes / t if t > 0 else 0))
+
+    # ---------- main loop ----------
+    def run(self):
+        if self.o["port"]:
+            self.fd = os.open(self.o["port"], os.O_RDWR | os.O_NOCTTY)
+            tty.setraw(self.fd)
+            self.set_baud(self.o["baud"])
+            print("[emu] on", self.o["port"])
+        else:
+            self.fd, slave = os.openpty()
+            tty.setraw(slave)
+            self.slave = slave         # keep the pty alive
+            print("[emu] ESP on", os.ttyname(slave))
+
+        self.boot()
+        if self.o["outage"]:
+            self.at(self.o["outage"][0], self.outage)
+        next_report = REPORT_S
+        try:
+            while True:
+                now = self.now()
+                while self.events and self.events[0][0] <= now:
+                    heapq.heappop(self.events)[2]()
+
+                if self.mode == "passthru" and self.plus and now - self.plus >= 0.9:
+                    self.mode, self.plus = "cmd", 0.0
+                    print("[emu] +++ : back to command mode")
+
+                if now >= next_report:
+                    next_report += REPORT_S
+                    self.report()
+
+                wait = 0.01 if not self.events else min(0.01, max(0, self.events[0][0] - now))
+                r, _, _ = select.select([self.fd], [], [], wait)
+                if r:
+                    try:
+                        data = os.read(self.fd, 4096)
+                    except OSError:
+                        data = b""
+                    if data:
+                        self.feed(data)
+                self.poll_links()
+        except KeyboardInterrupt:
+            pass
+        self.report()
+
+
+def parse(argv):
+    o = {"latency": 0.005, "join": 1.5, "inject": [], "every": 1.0, "links": 1,
+         "drop": 0.0, "garbage": 0.0, "forward": False, "port": None, "baud": 115200,
+         "outage": None}
+    i = 0
+    while i < len(argv):
+        a = argv[i]
+        if a == "--forward":
+            o["forward"] = True
+            i += 1
+            continue
+        if i + 1 >= len(argv):
+            sys.exit("missing value for " + a)
+        v = argv[i + 1]
+        if a == "--latency":
+            o["latency"] = float(v) / 1000
+        elif a == "--join":
+            o["join"] = float(v) / 1000
+        elif a == "--inject":
+            o["inject"] = v.split(",")
+        elif a == "--every":
+            o["every"] = float(v)
+        elif a == "--links":
+            o["links"] = int(v)
+        elif a == "--drop":
+            o["drop"] = float(v)
+        elif a == "--garbage":
+            o["garbage"] = float(v)
+        elif a == "--outage":
+            o["outage"] = tuple(float(x) for x in v.split(","))
+        elif a == "--port":
+            o["port"] = v
+        elif a == "--baud":
+            o["baud"] = int(v)
+        else:
+            sys.exit("unknown option " + a)
+        i += 2
+    return o
+
+
+if __name__ == "__main__":
+    Emulator(parse(sys.argv[1:])).run()
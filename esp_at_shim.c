@@ -0,0 +1,363 @@
+/* ================= ESP AT SHIM ================= */
+/* Runs an ESP project's main.c on a PC against esp_at_emulator.py.
+   main.c is included as it is; HOST_SIM drops its register block and
+   the macros below map the registers onto plain variables.
+   A 1 ms SIGALRM plays the hardware: it interrupts the firmware like
+   an IRQ would, moves bytes between USART3 and the emulator's pty and
+   calls SysTick_Handler, USART3_IRQHandler, DMA1_Channel2/3_IRQHandler
+   and ADC1_2_IRQHandler the way the STM32 would.
+
+     python3 esp_at_emulator.py --inject /,/on,/off --links 2
+         -> [emu] ESP on /dev/pts/N
+
+     gcc -O1 -no-pie -Wno-pointer-to-int-cast -Wno-int-to-pointer-cast \
+         -DFIRMWARE='"Blink_Led_ESP32_wifi_103C8Y6_Ver_002/main.c"' \
+         esp_at_shim.c -o shim_web
+     ./shim_web /dev/pts/N [seconds]
+
+     gcc ... -DFIRMWARE='"ESP32_Bare_Pot_103C8T6_Ver_001/main.c"' \
+         -DUPLINK_MODE=3 -DSERVER_IP='"127.0.0.1"' esp_at_shim.c -o shim_mqtt
+
+   USART2 (the debug port) goes to stdout. -no-pie is required: DMA
+   addresses are 32-bit registers, so buffers must sit below 4 GB.
+
+   Modelled: USART2/3 TX (TXE, TC always set), USART3 RX by RXNE
+   interrupt or circular DMA1 CH3 with HT/TC and IDLE, DMA1 CH2 TX with TC,
+   RX paced by USART3_BRR and held off while PB14 (RTS) is high,
+   GPIOB_BSRR, ADC1 calibration and EOC interrupt (a slow ramp on the
+   pot), SysTick. Not modelled: NVIC priorities, errors, other DMA
+   channels. */
+#define _DEFAULT_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <termios.h>
+#include <unistd.h>
+
+#ifndef FIRMWARE
+#error "build with -DFIRMWARE='\"<project>/main.c\"'"
+#endif
+
+/* ================= SIMULATED REGISTERS ================= */
+struct
+{
+    volatile uint32_t RCC_AHBENR, RCC_APB2ENR, RCC_APB1ENR, RCC_CFGR;
+    volatile uint32_t GPIOA_CRL, GPIOB_CRL, GPIOB_CRH, GPIOB_ODR, GPIOB_BSRR;
+    volatile uint32_t AFIO_MAPR;
+    volatile uint32_t USART2_SR, USART2_BRR, USART2_CR1;
+    volatile uint32_t USART3_SR, USART3_BRR, USART3_CR1, USART3_CR3;
+    volatile uint32_t DMA1_ISR, DMA1_IFCR;
+    volatile uint32_t DMA1_CCR2, DMA1_CNDTR2, DMA1_CPAR2, DMA1_CMAR2;
+    volatile uint32_t DMA1_CCR3, DMA1_CNDTR3, DMA1_CPAR3, DMA1_CMAR3;
+    volatile uint32_t ADC1_SR, ADC1_CR1, ADC1_CR2, ADC1_SMPR2, ADC1_SQR3, ADC1_DR;
+    volatile uint32_t SYST_CSR, SYST_RVR, SYST_CVR;
+    volatile uint32_t NVIC_ISER0, NVIC_ISER1;
+} sim;
+
+#define RCC_AHBENR    sim.RCC_AHBENR
+#define RCC_APB2ENR   sim.RCC_APB2ENR
+#define RCC_APB1ENR   sim.RCC_APB1ENR
+#define RCC_CFGR      sim.RCC_CFGR
+#define GPIOA_CRL     sim.GPIOA_CRL
+#define GPIOB_CRL     sim.GPIOB_CRL
+#define GPIOB_CRH     sim.GPIOB_CRH
+#define GPIOB_ODR     sim.GPIOB_ODR
+#define GPIOB_BSRR    sim.GPIOB_BSRR
+#define AFIO_MAPR     sim.AFIO_MAPR
+#define USART2_SR     sim.USART2_SR
+#define USART2_DR     (*sim_dr(&sim_usart2))
+#define USART2_BRR    sim.USART2_BRR
+#define USART2_CR1    sim.USART2_CR1
+#define USART3_SR     sim.USART3_SR
+#define USART3_DR     (*sim_dr(&sim_usart3))
+#define USART3_BRR    sim.USART3_BRR
+#define USART3_CR1    sim.USART3_CR1
+#define USART3_CR3    sim.USART3_CR3
+#define DMA1_ISR      sim.DMA1_ISR
+#define DMA1_IFCR     sim.DMA1_IFCR
+#define DMA1_CCR2     sim.DMA1_CCR2
+#define DMA1_CNDTR2   sim.DMA1_CNDTR2
+#define DMA1_CPAR2    sim.DMA1_CPAR2
+#define DMA1_CMAR2    sim.DMA1_CMAR2
+#define DMA1_CCR3     sim.DMA1_CCR3
+#define DMA1_CNDTR3   sim.DMA1_CNDTR3
+#define DMA1_CPAR3    sim.DMA1_CPAR3
+#define DMA1_CMAR3    sim.DMA1_CMAR3
+#define ADC1_SR       sim.ADC1_SR
+#define ADC1_CR1      sim.ADC1_CR1
+#define ADC1_CR2      sim.ADC1_CR2
+#define ADC1_SMPR2    sim.ADC1_SMPR2
+#define ADC1_SQR3     sim.ADC1_SQR3
+#define ADC1_DR       sim.ADC1_DR
+#define SYST_CSR      sim.SYST_CSR
+#define SYST_RVR      sim.SYST_RVR
+#define SYST_CVR      sim.SYST_CVR
+#define NVIC_ISER0    sim.NVIC_ISER0
+#define NVIC_ISER1    sim.NVIC_ISER1
+
+/* ================= USART DATA REGISTER ================= */
+/* DR is both ways on the STM32, so it is a cell behind sim_dr().
+   A value with SIM_MARK in its top byte was put there by the shim
+   (the RX byte an ISR is about to read, or nothing). Anything else
+   is a byte the firmware wrote: the next access to DR, or the next
+   tick, moves it to the TX queue. The swap is one xchg, so a tick
+   landing in the middle cannot send a byte twice. */
+#define SIM_MARK      0x5A000000u
+#define SIM_NONE      (SIM_MARK | 0x100)
+#define SIM_TXQ       4096                 // power of two
+
+typedef struct
+{
+    int               fd;
+    volatile uint32_t cell;
+    volatile uint32_t rx;                  // what a DR read returns
+    char              txq[SIM_TXQ];
+    volatile uint32_t tx_head, tx_tail;    // free-running
+} sim_uart_t;
+
+sim_uart_t sim_usart2 = { .fd = 1,  .cell = SIM_NONE, .rx = SIM_NONE };
+sim_uart_t sim_usart3 = { .fd = -1, .cell = SIM_NONE, .rx = SIM_NONE };
+
+volatile uint32_t *sim_dr(sim_uart_t *u)
+{
+    uint32_t v = __atomic_exchange_n(&u->cell, SIM_NONE, __ATOMIC_SEQ_CST);
+
+    if ((v & 0xFF000000u) != SIM_MARK && u->tx_head - u->tx_tail < SIM_TXQ)
+    {
+        u->txq[u->tx_head & (SIM_TXQ - 1)] = (char)v;
+        u->tx_head++;
+    }
+    u->cell = u->rx;
+    return &u->cell;
+}
+
+/* Tick only: send what the firmware wrote to DR so far */
+void sim_uart_flush(sim_uart_t *u)
+{
+    sim_dr(u);
+    while (u->tx_tail != u->tx_head)
+    {
+        uint32_t t = u->tx_tail & (SIM_TXQ - 1);
+        uint32_t n = u->tx_head - u->tx_tail;
+        ssize_t  w;
+
+        if (n > SIM_TXQ - t)
+            n = SIM_TXQ - t;
+        w = write(u->fd, u->txq + t, n);
+        if (w <= 0)
+            break;
+        u->tx_tail += w;
+    }
+}
+
+/* ================= FIRMWARE ================= */
+/* Handlers a project does not have stay 0 */
+void SysTick_Handler(void) __attribute__((weak));
+void USART3_IRQHandler(void) __attribute__((weak));
+void DMA1_Channel2_IRQHandler(void) __attribute__((weak));
+void DMA1_Channel3_IRQHandler(void) __attribute__((weak));
+void ADC1_2_IRQHandler(void) __attribute__((weak));
+
+#define HOST_SIM
+#define main firmware_main
+#include FIRMWARE
+#undef main
+
+/* ================= HARDWARE TICK ================= */
+/* An IRQ the project has no handler for is ignored */
+void sim_irq(void (*handler)(void))
+{
+    if (handler)
+        handler();
+}
+
+#define PCLK1_SIM_HZ  36000000UL
+
+uint32_t sim_ms;
+uint32_t sim_stop_ms;                      // 0: run until killed
+uint32_t sim_ch3_len;                      // CNDTR3 reload value
+uint32_t sim_pot;
+
+void sim_usart3_rx(void)
+{
+    char     buf[256];
+    uint32_t budget;
+    ssize_t  n;
+    int      dma = (USART3_CR3 & (1 << 6)) && (DMA1_CCR3 & (1 << 0));
+
+    if (!(USART3_CR1 & (1 << 13)) || !(USART3_CR1 & (1 << 2)))
+        return;
+    if (GPIOB_ODR & (1 << 14))             // RTS high: ESP holds off
+        return;
+
+    /* Bytes one ms carries at the programmed baud (10 bits each) */
+    budget = USART3_BRR ? PCLK1_SIM_HZ / USART3_BRR / 10000 : 1;
+    if (budget == 0)
+        budget = 1;
+    if (budget > sizeof(buf))
+        budget = sizeof(buf);
+
+    n = read(sim_usart3.fd, buf, budget);
+    if (n <= 0)
+        return;
+
+    if (dma && !sim_ch3_len)
+        sim_ch3_len = DMA1_CNDTR3;
+
+    for (ssize_t i = 0; i < n; i++)
+    {
+        if (dma)
+        {
+            volatile char *mem = (volatile char *)(uintptr_t)DMA1_CMAR3;
+
+            mem[sim_ch3_len - DMA1_CNDTR3] = buf[i];
+            if (--DMA1_CNDTR3 == 0)
+            {
+                DMA1_CNDTR3 = sim_ch3_len;  // circular
+                DMA1_ISR |= (1 << 9);       // TCIF3
+                if (DMA1_CCR3 & (1 << 1))   // TCIE
+                    sim_irq(DMA1_Channel3_IRQHandler);
+            }
+            else if (DMA1_CNDTR3 == sim_ch3_len / 2)
+            {
+                DMA1_ISR |= (1 << 10);      // HTIF3
+                if (DMA1_CCR3 & (1 << 2))   // HTIE
+                    sim_irq(DMA1_Channel3_IRQHandler);
+            }
+        }
+        else if (USART3_CR1 & (1 << 5))     // RXNEIE
+        {
+            sim_usart3.rx = SIM_MARK | (uint8_t)buf[i];
+            sim_usart3.cell = sim_usart3.rx;
+            USART3_SR |= (1 << 5);          // RXNE
+            sim_irq(USART3_IRQHandler);
+            USART3_SR &= ~(1 << 5);
+            sim_usart3.rx = SIM_NONE;
+            sim_usart3.cell = SIM_NONE;
+        }
+    }
+
+    /* Line idle after the burst */
+    if (USART3_CR1 & (1 << 4))              // IDLEIE
+    {
+        USART3_SR |= (1 << 4);              // IDLE
+        sim_irq(USART3_IRQHandler);
+        USART3_SR &= ~(1 << 4);
+    }
+}
+
+void sim_tick(int sig)
+{
+    uint32_t bsrr = GPIOB_BSRR;
+    int      saved = errno;
+
+    (void)sig;
+    sim_ms++;
+
+    USART2_SR |= (1 << 7) | (1 << 6);       // TXE, TC: never busy
+    USART3_SR |= (1 << 7) | (1 << 6);
+
+    /* BSRR: set low half, reset high half */
+    GPIOB_BSRR = 0;
+    GPIOB_ODR  = (GPIOB_ODR | (bsrr & 0xFFFF)) & ~(bsrr >> 16);
+
+    /* DR writes first, then a DMA block queued after them */
+    sim_uart_flush(&sim_usart3);
+    if ((DMA1_CCR2 & (1 << 0)) && DMA1_CNDTR2)
+    {
+        const char *p = (const char *)(uintptr_t)DMA1_CMAR2;
+        uint32_t    len = DMA1_CNDTR2;
+
+        while (len)
+        {
+            ssize_t w = write(sim_usart3.fd, p, len);
+
+            if (w <= 0)
+                break;
+            p   += w;
+            len -= w;
+        }
+        DMA1_CNDTR2 = 0;
+        DMA1_ISR   |= (1 << 5);             // TCIF2
+        if (DMA1_CCR2 & (1 << 1))           // TCIE
+            sim_irq(DMA1_Channel2_IRQHandler);
+    }
+
+    sim_usart3_rx();
+
+    /* ADC: calibration ends at once, one conversion per ms */
+    ADC1_CR2 &= ~((1 << 3) | (1 << 2));
+    if ((ADC1_CR2 & (1 << 0)) && (ADC1_CR1 & (1 << 5)))
+    {
+        sim_pot = (sim_pot + 1) % 8190;
+        ADC1_DR = sim_pot < 4095 ? sim_pot : 8190 - sim_pot;
+        ADC1_SR |= (1 << 1);                // EOC
+        sim_irq(ADC1_2_IRQHandler);
+        ADC1_SR &= ~(1 << 1);
+    }
+
+    if ((SYST_CSR & 3) == 3)
+        sim_irq(SysTick_Handler);
+
+    /* IFCR: CGIFx clears every flag of channel x */
+    for (int ch = 0; ch < 7; ch++)
+        if (DMA1_IFCR & (1u << (ch * 4)))
+            DMA1_ISR &= ~(0xFu << (ch * 4));
+    DMA1_IFCR = 0;
+
+    sim_uart_flush(&sim_usart2);
+
+    if (sim_stop_ms && sim_ms >= sim_stop_ms)
+        _exit(0);
+    errno = saved;
+}
+
+/* ================= MAIN ================= */
+int main(int argc, char **argv)
+{
+    struct termios    tio;
+    struct sigaction  sa;
+    struct itimerval  it;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <emulator pty> [seconds]\n", argv[0]);
+        return 2;
+    }
+    if ((uintptr_t)&sim > 0xFFFFFFFFu)
+    {
+        fprintf(stderr, "build with -no-pie: DMA addresses are 32-bit\n");
+        return 2;
+    }
+
+    sim_usart3.fd = open(argv[1], O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (sim_usart3.fd < 0)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    if (tcgetattr(sim_usart3.fd, &tio) == 0)
+    {
+        cfmakeraw(&tio);
+        tcsetattr(sim_usart3.fd, TCSANOW, &tio);
+    }
+    if (argc > 2)
+        sim_stop_ms = (uint32_t)(atof(argv[2]) * 1000);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sim_tick;
+    sa.sa_flags   = SA_RESTART;
+    sigaction(SIGALRM, &sa, 0);
+
+    it.it_interval.tv_sec  = 0;
+    it.it_interval.tv_usec = 1000;
+    it.it_value = it.it_interval;
+    setitimer(ITIMER_REAL, &it, 0);
+
+    return firmware_main();
+}
@@ -0,0 +1,129 @@
+import re
+import struct
+import sys
+
+# Rebuilds the text sent by LOG() (deferred logging) in the
+# SPI / I2C projects.
+#
+#   python3 log_decode.py Spi_Communication/SPI_Version_001/Objects/main.axf /dev/ttyUSB0 [baud]
+#   python3 log_decode.py I2C_Communication/I2C_version_001/Objects/main.axf capture.bin
+#
+# Wire record: 0xA0|nargs, id u16 (offset of the string in LOGSTR),
+# nargs x u32 (all little-endian). The .axf must match the flashed image.
+#
+# main.sct puts the .logstr input section in its own load region LOGSTR,
+# outside flash, so armlink keeps the strings only in the .axf, in an
+# output section named LOGSTR. A gcc build keeps the name .logstr. The
+# id of a string is its address minus the section base.
+#
+#   python3 log_decode.py main.axf --strings    list the table and exit
+
+LOG_SECTIONS = (b"LOGSTR", b".logstr")
+
+
+def read_logstr(path):
+    elf = open(path, "rb").read()
+    if elf[:4] != b"\x7fELF":
+        sys.exit("%s: not an ELF file" % path)
+
+    if elf[4] == 2:
+        shoff, = struct.unpack_from("<Q", elf, 0x28)
+        shentsize, shnum, shstrndx = struct.unpack_from("<HHH", elf, 0x3A)
+        sh = struct.Struct("<IIQQQQ")
+    else:
+        shoff, = struct.unpack_from("<I", elf, 0x20)
+        shentsize, shnum, shstrndx = struct.unpack_from("<HHH", elf, 0x2E)
+        sh = struct.Struct("<IIIIII")
+
+    sections = [sh.unpack_from(elf, shoff + i * shentsize) for i in range(shnum)]
+    names_off = sections[shstrndx][4]
+
+    def cstr(off):
+        return elf[off:elf.index(b"\0", off)]
+
+    for name, _t, _f, _addr, off, size in sections:
+        if cstr(names_off + name) not in LOG_SECTIONS:
+            continue
+
+        # Offsets from the section start are the ids LOG() sent
+        strings = {}
+        data = elf[off:off + size]
+        k = 0
+        while k < len(data):
+            if data[k] == 0:              # padding between strings
+                k += 1
+                continue
+            end = data.index(b"\0", k)
+            if k > 0xFFFF:
+                sys.exit("%s: LOGSTR larger than 64 KB" % path)
+            strings[k] = data[k:end].decode("latin-1")
+            k = end + 1
+        return strings
+
+    sys.exit("%s: no LOGSTR section; link with main.sct" % path)
+
+
+SPEC = re.compile(r"%[-+ #0]*\d*(?:\.\d+)?[a-zA-Z%]")
+
+
+def apply_format(fmt, args):
+    # Args arrive as raw u32; %d / %i take them back as signed
+    conv = [m.group()[-1] for m in SPEC.finditer(fmt) if m.group() != "%%"]
+    args = tuple(a - (1 << 32) if c in "di" and a & 0x80000000 else a
+                 for a, c in zip(args, conv))
+    return fmt % args
+
+
+def open_input(argv):
+    if len(argv) < 3:
+        return sys.stdin.buffer
+    if argv[2].startswith("/dev/"):
+        import serial
+        baud = int(argv[3]) if len(argv) > 3 else 9600
+        return serial.Serial(argv[2], baud)
+    return open(argv[2], "rb")
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit("usage: log_decode.py main.axf [port|file|--strings] [baud]")
+
+    strings = read_logstr(sys.argv[1])
+    if sys.argv[2:3] == ["--strings"]:
+        for sid in sorted(strings):
+            print("0x%04X %r" % (sid, strings[sid]))
+        return
+    src = open_input(sys.argv)
+
+    def read(n):
+        data = b""
+        while len(data) < n:
+            chunk = src.read(n - len(data))
+            if not chunk:
+                raise EOFError
+            data += chunk
+        return data
+
+    try:
+        while True:
+            head = read(1)[0]
+            if head & 0xF0 != 0xA0 or head & 0x0F > 4:
+                continue                  # not a record start, resync
+            sid, = struct.unpack("<H", read(2))
+            args = struct.unpack("<%dI" % (head & 0x0F), read(4 * (head & 0x0F)))
+            fmt = strings.get(sid)
+            if fmt is None:
+                sys.stdout.write("<unknown id 0x%04X %r>\n" % (sid, args))
+                continue
+            try:
+                text = apply_format(fmt, args)
+            except (TypeError, ValueError):
+                text = "%s %r" % (fmt, args)
+            sys.stdout.write(text.replace("\r\n", "\n"))
+            sys.stdout.flush()
+    except (EOFError, KeyboardInterrupt):
+        pass
+
+
+if __name__ == "__main__":
+    main()